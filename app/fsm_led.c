@@ -12,150 +12,43 @@ NRF_LOG_MODULE_REGISTER();
 
 #define VERBOSE                 0
 
-// State enumeration order must match the order of state
-// method entries in the state map
+// State enumeration, state functions, state map and transition table are
+// all generated from LED_STATES in fsm_led_def.h, which is generated from the
+// state diagram docs/fsm_led.dot
 enum States
 {
-    ST_INIT,            // 0 - Initial state, nothing can be done here
-    ST_INITIALIZE,      // 1 - Initialize FSM
-    ST_SOLID_OFF,       // 2 - LED is off
-    ST_SOLID_ON,        // 3 - LED is on
-    ST_PULSE_START,     // 4 - Start pulsing the LED
-    ST_PULSE_OFF,       // 5 - LED is off but will turn on after a delay
-    ST_PULSE_ON,        // 6 - LED if on but will turn off after a delay
-    ST_REP_START,       // 7 - Setup the pulse pattern for a run
-    ST_REP_DELAY,       // 8 - Wait before restarting a pulse pattern
-    ST_REP_DEC,         // 9 - Decrement the rep counter
+    LED_STATES(SM_X_STATE_ENUM)
 
     ST_MAX_STATES
 };
 
-#define SM_NAME                Led
-
 // State machine state functions
-STATE_DECLARE(Init, NoEventData)
-STATE_DECLARE(Initialize, LedInitData)
-STATE_DECLARE(SolidOff, NoEventData)
-STATE_DECLARE(SolidOn, NoEventData)
-STATE_DECLARE(PulseStart, LedPulseData)
-STATE_DECLARE(PulseOff, NoEventData)
-STATE_DECLARE(PulseOn, NoEventData)
-STATE_DECLARE(RepStart, NoEventData)
-STATE_DECLARE(RepDelay, NoEventData)
-STATE_DECLARE(RepDec, NoEventData)
-
-// State map to define state function order
-BEGIN_STATE_MAP(SM_NAME)
-    STATE_MAP_ENTRY(Init)
-    STATE_MAP_ENTRY(Initialize)
-    STATE_MAP_ENTRY(SolidOff)
-    STATE_MAP_ENTRY(SolidOn)
-    STATE_MAP_ENTRY(PulseStart)
-    STATE_MAP_ENTRY(PulseOff)
-    STATE_MAP_ENTRY(PulseOn)
-    STATE_MAP_ENTRY(RepStart)
-    STATE_MAP_ENTRY(RepDelay)
-    STATE_MAP_ENTRY(RepDec)
-END_STATE_MAP(SM_NAME)
-
-// LED initialize event.  Sent when the FSM is being initialized.
-EVENT_DEFINE(LED_Init, LedInitData)
-{
-    VERBOSE_ID();
-
-    BEGIN_TRANSITION_MAP                        // - Current State -
-        TRANSITION_MAP_ENTRY(ST_INITIALIZE)     // ST_INIT
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INITIALIZE
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_OFF
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_ON
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_PULSE_START
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_PULSE_OFF
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_PULSE_ON
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_START
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_REP_DELAY
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_DEC
-    END_TRANSITION_MAP(SM_NAME, pEventData)
-}
-
-// LED pulse event.  Sent when the LED should start pulsing in an on/off
-// pattern.
-EVENT_DEFINE(LED_Pulse, LedPulseData)
-{
-    VERBOSE_ID();
-
-    BEGIN_TRANSITION_MAP                        // - Current State -
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INIT
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INITIALIZE
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_SOLID_OFF
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_SOLID_ON
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_PULSE_START
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_PULSE_OFF
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_PULSE_ON
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_START
-        TRANSITION_MAP_ENTRY(ST_PULSE_START)    // ST_REP_DELAY
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_DEC
-    END_TRANSITION_MAP(SM_NAME, pEventData)
-}
-
-// LED on event.  Sent when the LED should be on.
-EVENT_DEFINE(LED_On, NoEventData)
-{
-    VERBOSE_ID();
-
-    BEGIN_TRANSITION_MAP                        // - Current State -
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INIT
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INITIALIZE
-        TRANSITION_MAP_ENTRY(ST_SOLID_ON)       // ST_SOLID_OFF
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_ON
-        TRANSITION_MAP_ENTRY(ST_SOLID_ON)       // ST_PULSE_START
-        TRANSITION_MAP_ENTRY(ST_SOLID_ON)       // ST_PULSE_OFF
-        TRANSITION_MAP_ENTRY(ST_SOLID_ON)       // ST_PULSE_ON
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_START
-        TRANSITION_MAP_ENTRY(ST_SOLID_ON)       // ST_REP_DELAY
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_DEC
-    END_TRANSITION_MAP(SM_NAME, pEventData)
-}
-
-// LED off event.  Sent when the LED should be off.
-EVENT_DEFINE(LED_Off, NoEventData)
-{
-    VERBOSE_ID();
-
-    BEGIN_TRANSITION_MAP                        // - Current State -
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INIT
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INITIALIZE
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_OFF
-        TRANSITION_MAP_ENTRY(ST_SOLID_OFF)      // ST_SOLID_ON
-        TRANSITION_MAP_ENTRY(ST_SOLID_OFF)      // ST_PULSE_START
-        TRANSITION_MAP_ENTRY(ST_SOLID_OFF)      // ST_PULSE_OFF
-        TRANSITION_MAP_ENTRY(ST_SOLID_OFF)      // ST_PULSE_ON
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_START
-        TRANSITION_MAP_ENTRY(ST_SOLID_OFF)      // ST_REP_DELAY
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_DEC
-    END_TRANSITION_MAP(SM_NAME, pEventData)
-}
-
-// LED change event.  This event would occur after the ST_PULSE_OFF or
-// ST_PULSE_ON states set a timer to generate the event to flip states.  We
-// don't send an internal event because the state machine will go into a
-// infinite loop (on sending off event and vice versa).
-EVENT_DEFINE(LED_Change, NoEventData)
-{
-    VERBOSE_ID();
-
-    BEGIN_TRANSITION_MAP                        // - Current State -
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INIT
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_INITIALIZE
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_OFF
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_SOLID_ON
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)     // ST_PULSE_START
-        TRANSITION_MAP_ENTRY(ST_REP_DEC)        // ST_PULSE_OFF
-        TRANSITION_MAP_ENTRY(ST_PULSE_OFF)      // ST_PULSE_ON
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_START
-        TRANSITION_MAP_ENTRY(ST_REP_START)      // ST_REP_DELAY
-        TRANSITION_MAP_ENTRY(CANNOT_HAPPEN)     // ST_REP_DEC
-    END_TRANSITION_MAP(SM_NAME, pEventData)
-}
+LED_STATES(SM_X_STATE_DECLARE)
+
+// Exit action of the pulsing superstate
+EXIT_DECLARE(Pulsing)
+
+// Guards and action of the transitions at the end of a pulse
+GUARD_DECLARE(RepsLeft, NoEventData)
+GUARD_DECLARE(NoDelay, NoEventData)
+ACTION_DECLARE(NextRep, NoEventData)
+
+// Transition table, state map and constant data.
+//
+// The change event occurs after the ST_PULSE_OFF, ST_PULSE_ON or ST_REP_DELAY
+// states set a timer to generate the event to flip states.  We don't send an
+// internal event because the state machine will go into a infinite loop (on
+// sending off event and vice versa).
+//
+// The pulsing states share the Pulse, On and Off transitions of their
+// ST_PULSING superstate, whose exit action stops the timer.  The resume event
+// goes back to the pulsing state that was left, with the pulse data and the
+// rep count as they were.
+//
+// The change event at the end of a pulse counts the rep and goes straight to
+// the next pulse, the next pattern or the delay before it, as chosen by the
+// guards of its guarded transitions.
+SM_MACHINE_HSM(Led, LED_STATES, LED_EVENTS, LED_PARENTS, LED_ACTIONS, LED_HISTORY, LED_GUARDED, LED_EV_MAX_EVENTS)
 
 STATE_DEFINE(Init, NoEventData)
 {
@@ -174,6 +67,9 @@ STATE_DEFINE(Initialize, LedInitData)
     pData->init.led = pEventData->led;
     pData->init.timer = pEventData->timer;
 
+    // Start the pattern from the beginning whenever the LED is initialized
+    SM_ClearHistory();
+
     NRF_LOG_DEBUG("%s initial", led_name(pData->init.led));
 
     SM_InternalEvent(ST_SOLID_OFF, NULL);
@@ -201,6 +97,25 @@ STATE_DEFINE(SolidOn, NoEventData)
     bsp_board_led_on(pData->init.led);
 }
 
+STATE_DEFINE(Pulsing, NoEventData)
+{
+    // Superstate of the pulsing states.  This function is only executed if
+    // the LED is resumed before it ever pulsed, there is nothing to resume.
+    VERBOSE_ID();
+
+    SM_InternalEvent(ST_SOLID_OFF, NULL);
+}
+
+EXIT_DEFINE(Pulsing)
+{
+    VERBOSE_ID();
+
+    Led *pData = SM_GetInstance(Led);
+
+    // Leaving the pulse pattern, a pending timer must not change the new state
+    xTimerStop(pData->init.timer, 0);
+}
+
 STATE_DEFINE(PulseStart, LedPulseData)
 {
     VERBOSE_ID();
@@ -298,6 +213,9 @@ STATE_DEFINE(RepDelay, NoEventData)
 
     Led *pData = SM_GetInstance(Led);
 
+    // Already off after a pulse, but deep history resumes straight here
+    bsp_board_led_off(pData->init.led);
+
     utils_start_timer(
         pData->init.timer,
         led_name(pData->init.led),
@@ -306,7 +224,23 @@ STATE_DEFINE(RepDelay, NoEventData)
     );
 }
 
-STATE_DEFINE(RepDec, NoEventData)
+GUARD_DEFINE(RepsLeft, NoEventData)
+{
+    Led *pData = SM_GetInstance(Led);
+
+    // The pulse that just ended isn't counted yet
+    return pData->reps > 1;
+}
+
+GUARD_DEFINE(NoDelay, NoEventData)
+{
+    Led *pData = SM_GetInstance(Led);
+
+    // Last rep, a simple pattern with no delay restarts immediately
+    return 0 == pData->pulse.delay_ms;
+}
+
+ACTION_DEFINE(NextRep, NoEventData)
 {
     VERBOSE_ID();
 
@@ -314,24 +248,4 @@ STATE_DEFINE(RepDec, NoEventData)
 
     // Decrement the remaining reps in the pattern
     pData->reps -= 1;
-
-    if (pData->reps > 0)
-    {
-        // Continue running
-        SM_InternalEvent(ST_PULSE_ON, NULL);
-    }
-    else
-    {
-        // Last rep, check if we're a simple pattern with no delay
-        if (0 == pData->pulse.delay_ms)
-        {
-            // Yes, immediately restart
-            SM_InternalEvent(ST_REP_START, NULL);
-        }
-        else
-        {
-            // No, delay first
-            SM_InternalEvent(ST_REP_DELAY, NULL);
-        }
-    }
 }
@@ -5,6 +5,7 @@
 
 #include "DataTypes.h"
 #include "StateMachine.h"
+#include "fsm_led_def.h"
 
 #include "FreeRTOS.h"
 #include "timers.h"
@@ -33,11 +34,15 @@ typedef struct
     uint8_t reps;               /**< Number of reps remaining in the current cycle. */
 } Led;
 
-// State machine event functions
-EVENT_DECLARE(LED_Init, LedInitData)
-EVENT_DECLARE(LED_Pulse, LedPulseData)
-EVENT_DECLARE(LED_On, NoEventData)
-EVENT_DECLARE(LED_Off, NoEventData)
-EVENT_DECLARE(LED_Change, NoEventData)
+// State machine events, in the column order of the transition table
+enum LedEvents
+{
+    LED_EVENTS(SM_X_EVENT_ENUM)
+
+    LED_EV_MAX_EVENTS
+};
+
+// State machine constant data, used to define LED FSM instances
+SM_DECLARE_CONST(Led)
 
 #endif // __X_FSM_LED_H
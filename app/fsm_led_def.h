@@ -0,0 +1,63 @@
+#ifndef __X_FSM_LED_DEF_H
+#define __X_FSM_LED_DEF_H
+
+// LED FSM definition, generated from docs/fsm_led.dot by tools/sm_gen.py.
+// Do not edit, change the diagram and regenerate.  See SM_MACHINE_TABLE in
+// StateMachine.h.
+
+// State machine events: event, event data type.  Event order is the column
+// order of the transition table.
+#define LED_EVENTS(X) \
+    X(LED_EV_INIT,    LedInitData)   /* Init */ \
+    X(LED_EV_PULSE,   LedPulseData)  /* Pulse */ \
+    X(LED_EV_ON,      NoEventData)   /* On */ \
+    X(LED_EV_OFF,     NoEventData)   /* Off */ \
+    X(LED_EV_RESUME,  NoEventData)   /* Resume */ \
+    X(LED_EV_CHANGE,  NoEventData)   /* Timer Expired */
+
+// State machine states: state, state function, state event data type and
+// the transition table row.
+#define LED_STATES(X) \
+    /*                                             LED_EV_INIT      LED_EV_PULSE     LED_EV_ON       LED_EV_OFF      LED_EV_RESUME   LED_EV_CHANGE    */ \
+    X(ST_INIT,         Init,        NoEventData,   (ST_INITIALIZE,  SM_DEFER,        SM_DEFER,       SM_DEFER,       SM_DEFER,       EVENT_IGNORED))  \
+    X(ST_INITIALIZE,   Initialize,  LedInitData,   (CANNOT_HAPPEN,  CANNOT_HAPPEN,   CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_SOLID_OFF,    SolidOff,    NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  ST_SOLID_ON,    EVENT_IGNORED,  ST_PULSING,     EVENT_IGNORED))  \
+    X(ST_SOLID_ON,     SolidOn,     NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  EVENT_IGNORED,  ST_SOLID_OFF,   ST_PULSING,     EVENT_IGNORED))  \
+    X(ST_PULSING,      Pulsing,     NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  ST_SOLID_ON,    ST_SOLID_OFF,   EVENT_IGNORED,  EVENT_IGNORED))  \
+    X(ST_PULSE_START,  PulseStart,  LedPulseData,  (CANNOT_HAPPEN,  CANNOT_HAPPEN,   CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_PULSE_OFF,    PulseOff,    NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  ST_SOLID_ON,    ST_SOLID_OFF,   EVENT_IGNORED,  SM_GUARDED))     \
+    X(ST_PULSE_ON,     PulseOn,     NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  ST_SOLID_ON,    ST_SOLID_OFF,   EVENT_IGNORED,  ST_PULSE_OFF))   \
+    X(ST_REP_START,    RepStart,    NoEventData,   (CANNOT_HAPPEN,  CANNOT_HAPPEN,   CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_REP_DELAY,    RepDelay,    NoEventData,   (EVENT_IGNORED,  ST_PULSE_START,  ST_SOLID_ON,    ST_SOLID_OFF,   EVENT_IGNORED,  ST_REP_START))
+
+// Automatic transitions made by state functions with SM_InternalEvent:
+// from state, to state.
+#define LED_INTERNAL(X) \
+    X(ST_INITIALIZE,   ST_SOLID_OFF)  \
+    X(ST_PULSING,      ST_SOLID_OFF)  /* no history */ \
+    X(ST_PULSE_START,  ST_REP_START)  \
+    X(ST_REP_START,    ST_PULSE_ON)
+
+// Superstates: state, superstate.
+#define LED_PARENTS(X) \
+    X(ST_PULSE_START,  ST_PULSING)  \
+    X(ST_PULSE_OFF,    ST_PULSING)  \
+    X(ST_PULSE_ON,     ST_PULSING)  \
+    X(ST_REP_START,    ST_PULSING)  \
+    X(ST_REP_DELAY,    ST_PULSING)
+
+// Entry and exit actions: state, entry function, exit function.
+#define LED_ACTIONS(X) \
+    X(ST_PULSING,  NULL,  EX_Pulsing)
+
+// Superstates with history: superstate, history, history slot.
+#define LED_HISTORY(X) \
+    X(ST_PULSING,  SM_HISTORY_DEEP,  0)
+
+// Guarded transitions: state, event, guard, action, new state.
+#define LED_GUARDED(X) \
+    X(ST_PULSE_OFF,  LED_EV_CHANGE,  GD_RepsLeft,  AC_NextRep,  ST_PULSE_ON)   \
+    X(ST_PULSE_OFF,  LED_EV_CHANGE,  GD_NoDelay,   AC_NextRep,  ST_REP_START)  \
+    X(ST_PULSE_OFF,  LED_EV_CHANGE,  NULL,         AC_NextRep,  ST_REP_DELAY)
+
+#endif // __X_FSM_LED_DEF_H
@@ -3,7 +3,6 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
-#include "queue.h"
 #include "timers.h"
 
 #define NRF_LOG_MODULE_NAME     led
@@ -16,6 +15,7 @@ NRF_LOG_MODULE_REGISTER();
 #include "led.h"
 #include "error_msg.h"
 #include "fsm_led.h"
+#include "sm_snapshot.h"
 #include "boards.h"
 #include "utils.h"
 
@@ -40,56 +40,50 @@ NRF_LOG_MODULE_REGISTER();
 #define VALID_LED(led, ret)
 #endif
 
-/**@brief   Enumeration of possible LED states.
- */
-typedef enum
-{
-    LED_STATE_Min = 0,
-
-    LED_STATE_INIT = LED_STATE_Min, /**< Initialize the LED FSM */
-    LED_STATE_ON,                   /**< LED is on solid */
-    LED_STATE_OFF,                  /**< LED if off solid */
-    LED_STATE_PULSE,                /**< LED is pulsing a on/off pattern */
-    LED_STATE_CHANGE,               /**< LED internal state indicating a change in a pulse pattern */
-
-    LED_STATE_Max,
-} led_state_t;
+#define QUEUE_EVENTS            4
 
-/**@brief   Structure queued to a LED thread to send events to the thread.
+/**@brief   Module global variable used to inidicate that the module has been
+ *          initialized.
  */
-typedef struct
-{
-    led_state_t state;          /**< State that the LED should be in. */
-    union
-    {
-        LedInitData init;       /**< Initialization data */
-        LedPulseData pulse;     /**< Pulse data */
-    };
-} led_event_t;
+static bool m_initialized = false;
 
-/**@brief   Structure used to hold handles for various objects needed by the LED threads.
+/**@brief   Timers used to pulse the LEDs.
  */
-typedef struct
-{
-    QueueHandle_t   queue;      /**< Queue used to receive events. */
-    TimerHandle_t   timer;      /**< Timer used to pulse the LED. */
-} led_thread_data_t;
+static TimerHandle_t m_timers[LEDS_NUMBER];
 
-#define QUEUE_EVENTS            4
-#define QUEUE_ITEM_SIZE         sizeof(led_event_t)
+/**@brief   LED objects controlled by the FSMs.
+ */
+static Led m_leds[LEDS_NUMBER];
 
-/**@brief   Module global variable used to inidicate that the module has been
- *          initialized.
+/**@brief   FSMs for each LED.  Events are run by whichever task sends them,
+ *          an event sent while the FSM is busy is queued and run by the task
+ *          that currently owns the FSM.
  */
-static bool m_initialized = false;
+SM_DEFINE_TABLE(LED1, &m_leds[BSP_BOARD_LED_0], Led, QUEUE_EVENTS, SM_LOCK_TRYPOST)
+SM_DEFINE_TABLE(LED2, &m_leds[BSP_BOARD_LED_1], Led, QUEUE_EVENTS, SM_LOCK_TRYPOST)
+SM_DEFINE_TABLE(LED3, &m_leds[BSP_BOARD_LED_2], Led, QUEUE_EVENTS, SM_LOCK_TRYPOST)
+SM_DEFINE_TABLE(LED4, &m_leds[BSP_BOARD_LED_3], Led, QUEUE_EVENTS, SM_LOCK_TRYPOST)
+
+/**@brief   Snapshots of the LED FSMs, kept in RAM that isn't initialized at
+ *          startup so they survive a warm reset.  A cold start leaves
+ *          garbage that fails the CRC check.
+ */
+static uint32_t m_snapshots[LEDS_NUMBER][(SM_SNAPSHOT_SIZE(sizeof(Led)) + 3) / 4]
+    __attribute__((section(".non_init")));
 
-/**@brief   Task handles for the LED threads.
+/**@brief   LEDs told to show something their snapshot doesn't have yet.
  */
-static TaskHandle_t m_threads[LEDS_NUMBER];
+static bool m_dirty[LEDS_NUMBER];
 
-/**@brief   Array of structures that contain the handles for thread data objects.
+/**@brief   A mapping of the BSP LED index to the FSM of the LED.
  */
-static led_thread_data_t m_data[LEDS_NUMBER];
+static SM_StateMachine * const m_fsm[LEDS_NUMBER] =
+{
+    &LED1Obj,
+    &LED2Obj,
+    &LED3Obj,
+    &LED4Obj,
+};
 
 /**@brief   A mapping of the name of the LED to the BSP LED index.
  */
@@ -105,97 +99,86 @@ static struct
     { "LED4",   BSP_BOARD_LED_3 },
 };
 
-/**@brief Thread for sending events to the FSM running the LED.
+/**@brief   Take a snapshot of the FSM of a LED if it is out of date.
+ *
+ * Called after every event sent to the FSM.  A snapshot skipped because the
+ * FSM is busy leaves the LED dirty, the task that owns the FSM takes it
+ * once it has run the queued events and its own event returns.  The
+ * scheduler is suspended so the tasks sending events to a LED don't write
+ * its snapshot at the same time.
  *
- * @param[in]   arg     Pointer used for passing some arbitrary information
- *                      (context) from the osThreadCreate() call to the thread.
+ * @param[in]   led         The LED to take the snapshot of.
+ * @param[in]   changed     true if the LED was told to show something new.
  */
-static void led_fsm_thread(void * arg)
+static void _led_snapshot(uint8_t led, bool changed)
 {
-    led_thread_data_t *self = (led_thread_data_t *) arg;
-#if VERBOSE
-    NRF_LOG_DEBUG("arg: %p", arg);
-    NRF_LOG_DEBUG("queue: %p", self->queue);
-    NRF_LOG_DEBUG("timer: %p", self->timer);
-#endif
-    // Define a LED object
-    Led led;
-
-    // Define a FSM
-    SM_DEFINE(LED, &led);
+    vTaskSuspendAll();
+    if (changed)
+    {
+        m_dirty[led] = true;
+    }
+    if (m_dirty[led] &&
+        _SM_Snapshot(m_fsm[led], sizeof(Led), m_snapshots[led], sizeof(m_snapshots[led])))
+    {
+        m_dirty[led] = false;
+    }
+    (void)xTaskResumeAll();
+}
 
-    while (1)
+/**@brief   Restore the FSM of a LED from its snapshot.
+ *
+ * The timer handle is fixed up before the current state runs again, which
+ * drives the LED and restarts its timer as required.
+ *
+ * @param[in]   led         The LED to restore.
+ *
+ * @return  true if restored, false if there is no valid snapshot.
+ */
+static bool _led_restore(uint8_t led)
+{
+    if (!_SM_Restore(m_fsm[led], sizeof(Led), m_snapshots[led], sizeof(m_snapshots[led])))
     {
-        led_event_t event;
+        return false;
+    }
 
-        if(pdPASS != xQueueReceive(self->queue, &event, portMAX_DELAY))
-        {
-            NRF_LOG_WARNING("Queue unexpectedly empty!");
-        }
-        else
-        {
+    m_leds[led].init.led = led;
+    m_leds[led].init.timer = m_timers[led];
 
-            switch (event.state)
-            {
-            case LED_STATE_INIT:
-            {
-                LedInitData *data;
-
-                data = SM_XAlloc(sizeof(LedInitData));
-                if (NULL != data)
-                {
-                    // Send the LED and the timer on on initialization, those
-                    // values are constant and won't change over the life of
-                    // the FSM
-                    data->led = event.init.led;
-                    data->timer = event.init.timer;
-                    SM_Event(LED, LED_Init, data);
-                }
-                else
-                {
-                    NRF_LOG_ERROR("Can't allocate memory for %d", event.state);
-                }
-            }
-                break;
-
-            case LED_STATE_ON:
-                SM_Event(LED, LED_On, NULL);
-                break;
-
-            case LED_STATE_OFF:
-                SM_Event(LED, LED_Off, NULL);
-                break;
-
-            case LED_STATE_PULSE:
-            {
-                LedPulseData *data;
-
-                data = SM_XAlloc(sizeof(LedPulseData));
-                if (NULL != data)
-                {
-                    data->reps = event.pulse.reps;
-                    data->on_ms = event.pulse.on_ms;
-                    data->off_ms = event.pulse.off_ms;
-                    data->delay_ms = event.pulse.delay_ms;
-                    SM_Event(LED, LED_Pulse, data);
-                }
-                else
-                {
-                    NRF_LOG_ERROR("Can't allocate memory for %d", event.state);
-                }
-            }
-                break;
-
-            case LED_STATE_CHANGE:
-                SM_Event(LED, LED_Change, NULL);
-                break;
-
-            default:
-                NRF_LOG_ERROR("Unexpected LED state: %d", event.state);
-                break;
-            }
+    return _SM_Reenter(m_fsm[led]);
+}
+
+/**@brief   Send an event to the FSM of a LED.
+ *
+ * The event runs in the calling task unless the FSM is busy, in which case
+ * it is queued for the task that owns the FSM.  The FSMs are kept in an
+ * array, so the FSM functions are called directly instead of through the
+ * SM_Dispatch() macros.
+ *
+ * @param[in]   led         The LED the event is for.
+ * @param[in]   event       The FSM event.
+ * @param[in]   data        Event data to copy, NULL if the event has no data.
+ * @param[in]   size        The size of the event data.
+ */
+static void _led_event(uint8_t led, uint8_t event, const void *data, size_t size)
+{
+    void *copy = NULL;
+
+    if (NULL != data)
+    {
+        copy = _SM_CopyEventData(m_fsm[led], data, size);
+        if (NULL == copy)
+        {
+            NRF_LOG_ERROR("Can't copy event data for %s", m_name_map[led].name);
+            return;
         }
     }
+
+    _SM_Dispatch(m_fsm[led], event, copy);
+
+    // Keep the pattern the LED was last told to show.  Timer changes only
+    // move through the pattern, so aren't worth a snapshot of their own, but
+    // may be the first chance to take one skipped while the FSM was busy.
+    _led_snapshot(led, LED_EV_CHANGE != event);
 }
 
 void _led_timer_callback(TimerHandle_t xTimer)
@@ -203,26 +186,18 @@ void _led_timer_callback(TimerHandle_t xTimer)
     // Get the LED that needs the event
     uint32_t led = (uint32_t) pvTimerGetTimerID(xTimer);
 
-    led_event_t event;
-
-    // Create and queue a change event
-    event.state = LED_STATE_CHANGE;
-
-    if (pdPASS != xQueueSendToBackFromISR(m_data[led].queue, &event, NULL))
-    {
-        NRF_LOG_ERROR("Failed to add %d event to queue for %s",
-            event.state,
-            m_name_map[led].name
-        );
-    }
+    // Send a change event
+    _led_event(led, LED_EV_CHANGE, NULL, 0);
 }
 
 #if LEDS_NUMBER != 4
 #error LEDS_NUMBER is expected to be 4, led_init() will need to be updated.
 #endif
 
-void led_init(void)
+bool led_init(void)
 {
+    bool restored = true;
+
     for (int i = 0; i < LEDS_NUMBER; i++)
     {
         // We use a 32 bit value for the LED so that we can cast it to a void
@@ -230,80 +205,57 @@ void led_init(void)
         uint32_t led = m_name_map[i].led;
         char *name = m_name_map[i].name;
 
-        // Create queue for event data
-        m_data[led].queue = xQueueCreate(QUEUE_EVENTS, QUEUE_ITEM_SIZE);
-        if (NULL == m_data[led].queue)
-        {
-            NRF_LOG_ERROR("%s event queue could not be created", name);
-            NRF_LOG_FLUSH();
-            return;
-        }
-#if VERBOSE
-        else
-        {
-            NRF_LOG_DEBUG("%s event queue handle: %p", name, m_data[led].queue);
-        }
-#endif
         // Create timer to pulse LED when required
-        m_data[led].timer = xTimerCreate(
+        m_timers[led] = xTimerCreate(
             name,               // Timer name is the LED name
             1,                  // Initial timer period, unused
             pdFALSE,            // Timer doesn't autoreload
             (void * )led,       // Unique ID of the timer
             _led_timer_callback // Each timer calls the same callback
         );
-        if (NULL == m_data[led].timer)
+        if (NULL == m_timers[led])
         {
             NRF_LOG_ERROR("%s timer could not be created", name);
             NRF_LOG_FLUSH();
-            return;
+            return false;
         }
 #if VERBOSE
         else
         {
-            NRF_LOG_DEBUG("%s timer handle: %p", name, m_data[led].timer);
+            NRF_LOG_DEBUG("%s timer handle: %p", name, m_timers[led]);
         }
 #endif
-        // Create a thread for the LED
-        if (pdPASS != xTaskCreate(
-            led_fsm_thread,         // task code
-            name,                   // name
-            512,                    // stack size in words
-            (void *)&m_data[led],   // pvParameters
-            1,                      // uxPriority -- one step above idle
-            &m_threads[led])        // *pxCreatedTask
-        )
-        {
-            NRF_LOG_ERROR("%s thread could not be created", name);
-            NRF_LOG_FLUSH();
-            return;
-        }
+    }
 #if VERBOSE
-        else
-        {
-            NRF_LOG_DEBUG("%s thread handle: %p", name, m_threads[led]);
-        }
+    NRF_LOG_DEBUG("LED timers created");
+    NRF_LOG_FLUSH();
 #endif
-        // Initialize the LED FSM
-        led_event_t event;
-        event.state = LED_STATE_INIT;
-        event.init.led = led;
-        event.init.timer = m_data[led].timer;
+    // We're initialized to the point that we can call our methods, the FSMs
+    // use them as soon as they run
+    m_initialized = true;
+
+    for (int i = 0; i < LEDS_NUMBER; i++)
+    {
+        uint8_t led = m_name_map[i].led;
 
-        if (pdPASS != xQueueSendToBack(m_data[led].queue, &event, 0))
+        // After a warm reset carry on with the pattern the LED was showing
+        if (_led_restore(led))
         {
-            NRF_LOG_ERROR("Failed to add %d event to %s queue",
-                event.state,
-                name
-            );
+            NRF_LOG_INFO("%s restored", m_name_map[i].name);
+            continue;
         }
+        restored = false;
+
+        // Initialize the LED FSM.  The LED and the timer are constant and
+        // won't change over the life of the FSM.
+        LedInitData init;
+        init.led = led;
+        init.timer = m_timers[led];
+
+        _led_event(led, LED_EV_INIT, &init, sizeof(init));
     }
-#if VERBOSE
-    NRF_LOG_DEBUG("LED threads created");
-    NRF_LOG_FLUSH();
-#endif
-    // We're initialized to the point that we can call our methods
-    m_initialized = true;
+
+    return restored;
 }
 
 void led_on(uint8_t led)
@@ -312,17 +264,7 @@ void led_on(uint8_t led)
 
     VALID_LED(led, );
 
-    led_event_t event;
-
-    event.state = LED_STATE_ON;
-
-    if (pdPASS != xQueueSendToBackFromISR(m_data[led].queue, &event, NULL))
-    {
-        NRF_LOG_ERROR("Failed to add %d event to queue for %s",
-            event.state,
-            m_name_map[led].name
-        );
-    }
+    _led_event(led, LED_EV_ON, NULL, 0);
 }
 
 void led_off(uint8_t led)
@@ -331,17 +273,7 @@ void led_off(uint8_t led)
 
     VALID_LED(led, );
 
-    led_event_t event;
-
-    event.state = LED_STATE_OFF;
-
-    if (pdPASS != xQueueSendToBackFromISR(m_data[led].queue, &event, NULL))
-    {
-        NRF_LOG_ERROR("Failed to add %d event to queue for %s",
-            event.state,
-            m_name_map[led].name
-        );
-    }
+    _led_event(led, LED_EV_OFF, NULL, 0);
 }
 
 void led_pulse(uint8_t led, uint16_t on_ms, uint16_t off_ms)
@@ -355,21 +287,23 @@ void led_pattern(uint8_t led, uint8_t reps, uint16_t on_ms, uint16_t off_ms, uin
 
     VALID_LED(led, );
 
-    led_event_t event;
+    LedPulseData pulse;
 
-    event.state = LED_STATE_PULSE;
-    event.pulse.reps = reps;
-    event.pulse.on_ms = on_ms;
-    event.pulse.off_ms = off_ms;
-    event.pulse.delay_ms = delay_ms;
+    pulse.reps = reps;
+    pulse.on_ms = on_ms;
+    pulse.off_ms = off_ms;
+    pulse.delay_ms = delay_ms;
 
-    if (pdPASS != xQueueSendToBackFromISR(m_data[led].queue, &event, NULL))
-    {
-        NRF_LOG_ERROR("Failed to add %d event to queue for %s",
-            event.state,
-            m_name_map[led].name
-        );
-    }
+    _led_event(led, LED_EV_PULSE, &pulse, sizeof(pulse));
+}
+
+void led_resume(uint8_t led)
+{
+    MODULE_INITIALIZED();
+
+    VALID_LED(led, );
+
+    _led_event(led, LED_EV_RESUME, NULL, 0);
 }
 
 const char * led_name(uint8_t led)
@@ -380,4 +314,3 @@ const char * led_name(uint8_t led)
 
     return m_name_map[led].name;
 }
-
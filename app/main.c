@@ -63,6 +63,7 @@ NRF_LOG_MODULE_REGISTER();
 #include "boards.h"
 #include "version.h"
 #include "led.h"
+#include "sm_port.h"
 #include "error_msg.h"
 
 /**@brief   Value used as error code on stack dump, can be used to identify
@@ -215,16 +216,22 @@ int main(void)
     // Configure board LED pins as outputs
     bsp_board_init(BSP_INIT_LEDS);
 
-    // Create FSM's
-    led_init();
+    // Start the cycle counter the FSM profiles and rings time events with
+    SM_PORT_INIT();
+
+    // Create FSM's, after a warm reset they carry on where they were
+    bool restored = led_init();
 
     task_info();
 
     // Set the initial states of the LEDs
-    LED_ON(BSP_BOARD_LED_0);
-    LED_SLOW(BSP_BOARD_LED_1);
-    LED_FAST(BSP_BOARD_LED_2);
-    LED_HEARTBEAT(BSP_BOARD_LED_3);
+    if (!restored)
+    {
+        LED_ON(BSP_BOARD_LED_0);
+        LED_SLOW(BSP_BOARD_LED_1);
+        LED_FAST(BSP_BOARD_LED_2);
+        LED_HEARTBEAT(BSP_BOARD_LED_3);
+    }
 
     // Start FreeRTOS scheduler.
     vTaskStartScheduler();
@@ -10,6 +10,7 @@
 	typedef unsigned short UINT16;
 	typedef unsigned int UINT32;
 	typedef int INT32;
+	typedef unsigned long long UINT64;
 	typedef char CHAR;
 	typedef short SHORT;
 	typedef long LONG;
@@ -8,7 +8,12 @@ extern "C" {
 // Used for compile-time checking for array sizes. On Windows VC++, you get 
 // an "error C2118: negative subscript" error.
 #ifndef C_ASSERT
-#define C_ASSERT(expr)  {char uname[(expr)?1:-1];uname[0]=0;}
+#define C_ASSERT(expr)  {char uname[(expr)?1:-1];uname[0]=0;(void)uname;}
+#endif
+
+// File scope version of C_ASSERT. The name must be unique within the file.
+#ifndef C_ASSERT_GLOBAL
+#define C_ASSERT_GLOBAL(name, expr)  typedef char name[(expr)?1:-1]
 #endif
 
 #define ASSERT_TRUE(condition) \
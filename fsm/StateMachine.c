@@ -1,53 +1,272 @@
+#include <string.h>
+
 #include "Fault.h"
 #include "StateMachine.h"
+#include "sm_trace.h"
 
+#ifdef SM_PORT_HOST
+// Host builds have no log backend, the arguments are still used
+static inline void _SM_LogNothing(const char* format, ...)
+{
+    (void)format;
+}
+#define NRF_LOG_DEBUG(...)      _SM_LogNothing(__VA_ARGS__)
+#else
 #define NRF_LOG_MODULE_NAME     fsm
 #define NRF_LOG_LEVEL           4
 #include "nrf_log.h"
 NRF_LOG_MODULE_REGISTER();
+#endif
+
+#ifdef USE_SM_TRACE
+// Traces a transition to newState, EVENT_IGNORED_16 if the event is ignored
+// or SM_DEFER_16 if it is deferred
+void _SM_TraceTransition(SM_StateMachine* self, SM_StateId newState, void* pEventData)
+{
+    UINT16 size = 0;
+
+    // Only the size of event data copied into the slot is known
+    if (pEventData == self->eventData.bytes)
+        size = self->eventDataSize;
+    else if (pEventData)
+        size = SM_TRACE_SIZE_UNKNOWN;
+
+    SM_TraceTransition(&self->traceId, self->name, self->eventId, self->currentState, newState, size);
+
+    // Any further transitions of this event are internal events
+    self->eventId = SM_TRACE_EVENT_INTERNAL;
+}
+#endif
+
+// SM_LogHooks log the instances defined with SM_DEFINE_VERBOSE, machines
+// with other hooks never look at the flag
+static void _SM_LogTransition(SM_StateMachine* self, SM_StateId from, SM_StateId to, void* pEventData)
+{
+    (void)pEventData;
+
+    if (self->verbose)
+        NRF_LOG_DEBUG("%s: %d -> %d", self->name, from, to);
+}
+
+static void _SM_LogIgnore(SM_StateMachine* self, void* pEventData)
+{
+    (void)pEventData;
+
+    if (self->verbose)
+        NRF_LOG_DEBUG("%s: current %d, event ignored", self->name, self->currentState);
+}
+
+static void _SM_LogGuardFail(SM_StateMachine* self, SM_StateId newState, void* pEventData)
+{
+    (void)pEventData;
+
+    if (self->verbose)
+        NRF_LOG_DEBUG("%s: current %d, guard of %d failed", self->name, self->currentState, newState);
+}
+
+const SM_Hooks SM_LogHooks = { _SM_LogTransition, _SM_LogIgnore, _SM_LogGuardFail, SM_NoEntryHook, SM_NoExitHook };
 
 // Generates an external event. Called once per external event 
 // to start the state machine executing
-void _SM_ExternalEvent(SM_StateMachine* self, const SM_StateMachineConst* selfConst, BYTE newState, void* pEventData)
+void _SM_ExternalEvent(SM_StateMachine* self, const SM_StateMachineConst* selfConst, SM_StateId newState, void* pEventData)
 {
+#ifdef USE_SM_PROFILE
+    // Start the residency clock of the initial state with the first event
+    if (self->profileId == 0)
+        SM_ProfileRegister(&self->profileId, self->name);
+#endif
+
     // If we are supposed to ignore this event
-    if (newState == EVENT_IGNORED) 
+    if (newState == EVENT_IGNORED_16) 
     {
-        if (self->verbose)
-        {
-            NRF_LOG_DEBUG("%s: current %d, event ignored", self->name, self->currentState);
-        }
+        _SM_TRACE(self, newState, pEventData);
+        _SM_HOOK(selfConst, onIgnore, self, pEventData);
 
         // Just delete the event data, if any
         if (pEventData)
-            SM_XFree(pEventData);
+            _SM_FreeEventData(self, pEventData);
     }
     else 
     {
-        // TODO - capture software lock here for thread-safety if necessary
+        // Events sent through SM_Event hold the state machine lock here, see
+        // _SM_Acquire
+
+        _SM_WCET_CHAIN_BEGIN(self);
 
         // Generate the event 
         _SM_InternalEvent(self, newState, pEventData);
 
         // Execute state machine based on type of state map defined
-        if (selfConst->stateMap)
+        if (selfConst->engine)
+            selfConst->engine(self);
+        else if (selfConst->stateMap)
             _SM_StateEngine(self, selfConst);
         else
             _SM_StateEngineEx(self, selfConst);
 
-        // TODO - release software lock here 
+        _SM_WCET_CHAIN_END(self, selfConst);
     }
 }
 
-// Generates an internal event. Called from within a state 
-// function to transition to a new state
-void _SM_InternalEvent(SM_StateMachine* self, BYTE newState, void* pEventData)
+// Returns the superstate of a hierarchical state machine state. Parents are
+// stored plus one, zero for a top level state.
+#define _SM_PARENT(_selfConst_, _state_) \
+    ((SM_StateId)((_selfConst_)->parents[_state_] - 1))
+
+static BYTE _SM_Depth(const SM_StateMachineConst* selfConst, SM_StateId state)
 {
-    ASSERT_TRUE(self);
+    BYTE depth = 0;
+
+    while (selfConst->parents[state])
+    {
+        state = _SM_PARENT(selfConst, state);
+        depth++;
+        ASSERT_TRUE(depth < SM_HSM_MAX_DEPTH);
+    }
+
+    return depth;
+}
+
+// Runs the exit action of a hierarchical state machine state. A superstate
+// with history left from its substate child remembers child, or the current
+// state for deep history. A superstate left while it is the current state
+// forgets its history, so it isn't resumed in a substate left earlier.
+static void _SM_Exit(SM_StateMachine* self, const SM_StateMachineConst* selfConst, SM_StateId state, SM_StateId child)
+{
+    if (selfConst->history && selfConst->history[state])
+    {
+        BYTE history = selfConst->history[state];
+
+        if (history & SM_HISTORY_DEEP)
+            child = self->currentState;
+        self->history[history & SM_HISTORY_SLOT] = (child == state) ? 0 : child + 1;
+    }
+
+    _SM_HOOK(selfConst, onExit, self, state);
+    if (selfConst->actions[state].pExitFunc)
+    {
+        _SM_WCET_BEGIN();
+        selfConst->actions[state].pExitFunc(self);
+        _SM_WCET_END(selfConst, state, SM_WCET_EXIT);
+    }
+}
+
+// Returns the state a transition to state goes to. A superstate with history
+// that has been left before resumes the substate it remembers.
+static SM_StateId _SM_Resume(SM_StateMachine* self, const SM_StateMachineConst* selfConst, SM_StateId state)
+{
+    BYTE history = selfConst->history[state];
+
+    if (history && self->history[history & SM_HISTORY_SLOT])
+        return self->history[history & SM_HISTORY_SLOT] - 1;
+
+    return state;
+}
+
+// Runs the exit actions of a hierarchical state machine from the current
+// state up to the least common ancestor of the current and new states, then
+// the entry actions from below the ancestor down to the new state
+static void _SM_ExitEnter(SM_StateMachine* self, const SM_StateMachineConst* selfConst, void* pEventData)
+{
+    SM_StateId from = self->currentState;
+    SM_StateId to = self->newState;
+    SM_StateId child = from;
+    BYTE fromDepth, toDepth;
+    SM_StateId entries[SM_HSM_MAX_DEPTH];
+    BYTE count = 0;
+
+    // A transition to the current state is local, nothing is exited
+    if (from == to)
+        return;
+
+    fromDepth = _SM_Depth(selfConst, from);
+    toDepth = _SM_Depth(selfConst, to);
+
+    // Climb to the same depth, then climb both until they meet
+    while (fromDepth > toDepth)
+    {
+        _SM_Exit(self, selfConst, from, child);
+        child = from;
+        from = _SM_PARENT(selfConst, from);
+        fromDepth--;
+    }
+    while (toDepth > fromDepth)
+    {
+        entries[count++] = to;
+        to = _SM_PARENT(selfConst, to);
+        toDepth--;
+    }
+    while (from != to)
+    {
+        _SM_Exit(self, selfConst, from, child);
+        child = from;
+        entries[count++] = to;
+
+        // Different top level states have no common ancestor
+        if (fromDepth == 0)
+            break;
+
+        from = _SM_PARENT(selfConst, from);
+        to = _SM_PARENT(selfConst, to);
+        fromDepth--;
+    }
+
+    // Enter outermost first
+    while (count)
+    {
+        SM_StateId state = entries[--count];
+
+        _SM_HOOK(selfConst, onEntry, self, state);
+        if (selfConst->actions[state].pEntryFunc)
+        {
+            _SM_WCET_BEGIN();
+            selfConst->actions[state].pEntryFunc(self, pEventData);
+            _SM_WCET_END(selfConst, state, SM_WCET_ENTRY);
+        }
+    }
+
+    // Ensure exit/entry actions didn't call SM_InternalEvent by accident
+    ASSERT_TRUE(self->eventGenerated == FALSE);
+}
+
+// Switches to the new state generated by an event and runs the superstate
+// actions of the transition. Returns the event data for the new state's
+// state function, which the caller releases after calling it.
+void* _SM_StateEnter(SM_StateMachine* self, const SM_StateMachineConst* selfConst)
+{
+    void* pDataTemp;
+
+    // Error check that the new state is valid before proceeding
+    ASSERT_TRUE(self->newState < selfConst->maxStates);
+
+    // Resume a superstate with history
+    if (selfConst->history)
+        self->newState = _SM_Resume(self, selfConst, self->newState);
 
-    self->pEventData = pEventData;
-    self->eventGenerated = TRUE;
-    self->newState = newState;
+    // Copy of event data pointer
+    pDataTemp = self->pEventData;
+
+    // Event data used up, reset the pointer
+    self->pEventData = NULL;
+
+    // Event used up, reset the flag
+    self->eventGenerated = FALSE;
+
+    // Leave and enter superstates of a hierarchical state machine
+    if (selfConst->parents && selfConst->actions)
+        _SM_ExitEnter(self, selfConst, pDataTemp);
+#ifdef USE_SM_HOOKS
+    else if (self->newState != self->currentState)
+    {
+        _SM_HOOK(selfConst, onExit, self, self->currentState);
+        _SM_HOOK(selfConst, onEntry, self, self->newState);
+    }
+#endif
+
+    // Switch to the new current state
+    _SM_Switch(self, selfConst, pDataTemp);
+
+    return pDataTemp;
 }
 
 // The state engine executes the state machine states
@@ -61,36 +280,25 @@ void _SM_StateEngine(SM_StateMachine* self, const SM_StateMachineConst* selfCons
     // While events are being generated keep executing states
     while (self->eventGenerated)
     {
-        // Error check that the new state is valid before proceeding
-        ASSERT_TRUE(self->newState < selfConst->maxStates);
+        pDataTemp = _SM_StateEnter(self, selfConst);
 
         // Get the pointers from the state map
-        SM_StateFunc state = selfConst->stateMap[self->newState].pStateFunc;
-
-        // Copy of event data pointer
-        pDataTemp = self->pEventData;
-
-        // Event data used up, reset the pointer
-        self->pEventData = NULL;
-
-        // Event used up, reset the flag
-        self->eventGenerated = FALSE;
-
-        // Switch to the new current state
-        if (self->verbose)
-        {
-            NRF_LOG_DEBUG("%s: %d -> %d", self->name, self->currentState, self->newState);
-        }
-        self->currentState = self->newState;
+        SM_StateFunc state = selfConst->stateMap[self->currentState].pStateFunc;
 
         // Execute the state action passing in event data
         ASSERT_TRUE(state != NULL);
-        state(self, pDataTemp);
+        {
+            _SM_PROFILE_BEGIN();
+            _SM_WCET_BEGIN();
+            state(self, pDataTemp);
+            _SM_WCET_STATE_END(self, selfConst);
+            _SM_PROFILE_END(self);
+        }
 
         // If event data was used, then delete it
         if (pDataTemp)
         {
-            SM_XFree(pDataTemp);
+            _SM_FreeEventData(self, pDataTemp);
             pDataTemp = NULL;
         }
     }
@@ -128,7 +336,11 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
 
         // Execute the guard condition
         if (guard != NULL)
+        {
+            _SM_WCET_BEGIN();
             guardResult = guard(self, pDataTemp);
+            _SM_WCET_END(selfConst, self->newState, SM_WCET_GUARD);
+        }
 
         // If the guard condition succeeds
         if (guardResult == TRUE)
@@ -137,34 +349,755 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
             if (self->newState != self->currentState)
             {
                 // Execute the state exit action on current state before switching to new state
+                _SM_HOOK(selfConst, onExit, self, self->currentState);
                 if (exit != NULL)
+                {
+                    _SM_WCET_BEGIN();
                     exit(self);
+                    _SM_WCET_END(selfConst, self->currentState, SM_WCET_EXIT);
+                }
 
                 // Execute the state entry action on the new state
+                _SM_HOOK(selfConst, onEntry, self, self->newState);
                 if (entry != NULL)
+                {
+                    _SM_WCET_BEGIN();
                     entry(self, pDataTemp);
+                    _SM_WCET_END(selfConst, self->newState, SM_WCET_ENTRY);
+                }
 
                 // Ensure exit/entry actions didn't call SM_InternalEvent by accident 
                 ASSERT_TRUE(self->eventGenerated == FALSE);
             }
 
             // Switch to the new current state
-            if (self->verbose)
-            {
-                NRF_LOG_DEBUG("%s: %d -> %d", self->name, self->currentState, self->newState);
-            }
-            self->currentState = self->newState;
+            _SM_Switch(self, selfConst, pDataTemp);
 
             // Execute the state action passing in event data
             ASSERT_TRUE(state != NULL);
-            state(self, pDataTemp);
+            {
+                _SM_PROFILE_BEGIN();
+                _SM_WCET_BEGIN();
+                state(self, pDataTemp);
+                _SM_WCET_STATE_END(self, selfConst);
+                _SM_PROFILE_END(self);
+            }
+        }
+        else
+        {
+            _SM_HOOK(selfConst, onGuardFail, self, self->newState, pDataTemp);
         }
 
         // If event data was used, then delete it
         if (pDataTemp)
         {
-            SM_XFree(pDataTemp);
+            _SM_FreeEventData(self, pDataTemp);
             pDataTemp = NULL;
         }
     }
 }
+
+// Copies event data into the instance's event data slot, or into a block
+// from SM_XAlloc if the slot is too small or already holds pending data
+void* _SM_CopyEventData(SM_StateMachine* self, const void* pEventData, size_t size)
+{
+    void* pCopy = NULL;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(pEventData);
+
+    if (size <= SM_EVENT_DATA_SIZE)
+    {
+        // Claim the slot, it may also be claimed from another context
+        SM_CRITICAL_ENTER();
+        if (self->eventDataBusy)
+        {
+            pCopy = NULL;
+        }
+        else
+        {
+            self->eventDataBusy = TRUE;
+            self->eventDataSize = (UINT16)size;
+            pCopy = self->eventData.bytes;
+        }
+        SM_CRITICAL_EXIT();
+    }
+
+    if (pCopy == NULL)
+    {
+        pCopy = SM_XAlloc(size);
+        if (pCopy == NULL)
+            return NULL;
+    }
+
+    memcpy(pCopy, pEventData, size);
+    return pCopy;
+}
+
+// Releases event data once the state machine is done with it
+void _SM_FreeEventData(SM_StateMachine* self, void* pEventData)
+{
+    ASSERT_TRUE(self);
+
+    // Event data shared by the regions is released once all have run it
+    if (pEventData == self->pRegionData)
+        return;
+
+    if (pEventData == self->eventData.bytes)
+        self->eventDataBusy = FALSE;
+    else
+        SM_XFree(pEventData);
+}
+
+// Removes the oldest event from the queue. Returns FALSE if the queue is empty.
+static BOOL _SM_Pop(SM_StateMachine* self, SM_EventEntry* pEntry)
+{
+    BOOL popped = FALSE;
+
+    SM_CRITICAL_ENTER();
+    if (self->queueCount > 0)
+    {
+        *pEntry = self->queue[self->queueHead];
+        if (++self->queueHead == self->queueSize)
+            self->queueHead = 0;
+        self->queueCount--;
+        popped = TRUE;
+    }
+    SM_CRITICAL_EXIT();
+
+    return popped;
+}
+
+// Looks up the next state of a table mode event. Events a state inherits are
+// looked up in its superstates, an event no superstate handles is ignored.
+// The state whose cell was used is returned in pState.
+static SM_StateId _SM_Lookup(const SM_StateMachineConst* selfConst, SM_StateId* pState, BYTE eventId)
+{
+    SM_StateId state = *pState;
+    SM_StateId newState = _SM_TableCell(selfConst, state, eventId);
+
+    while (newState == SM_INHERIT_16)
+    {
+        if (!selfConst->parents || !selfConst->parents[state])
+            return EVENT_IGNORED_16;
+
+        state = _SM_PARENT(selfConst, state);
+        newState = _SM_TableCell(selfConst, state, eventId);
+    }
+
+    *pState = state;
+    return newState;
+}
+
+// Chooses the guarded transition of an SM_GUARDED cell. The first guarded
+// transition of the state and event whose guard passes, or that has no
+// guard, runs its action and gives the new state. The event is ignored if
+// every guard fails.
+static SM_StateId _SM_Guarded(SM_StateMachine* self, const SM_StateMachineConst* selfConst,
+    SM_StateId state, BYTE eventId, void* pEventData)
+{
+    const SM_GuardedTransition* pTransition = selfConst->guarded;
+    const SM_GuardedTransition* pEnd = pTransition + selfConst->guardedCount;
+
+    ASSERT_TRUE(pTransition);
+
+    while (pTransition < pEnd && (pTransition->state != state || pTransition->eventId != eventId))
+        pTransition++;
+
+    // An SM_GUARDED cell must have guarded transitions
+    ASSERT_TRUE(pTransition < pEnd);
+
+    for (; pTransition < pEnd && pTransition->state == state && pTransition->eventId == eventId; pTransition++)
+    {
+        BOOL guardResult = TRUE;
+
+        ASSERT_TRUE(pTransition->newState < selfConst->maxStates);
+
+        if (pTransition->guard)
+        {
+            _SM_WCET_BEGIN();
+            guardResult = pTransition->guard(self, pEventData);
+            _SM_WCET_END(selfConst, pTransition->newState, SM_WCET_GUARD);
+        }
+
+        if (guardResult)
+        {
+            if (pTransition->action)
+            {
+                _SM_WCET_BEGIN();
+                pTransition->action(self, pEventData);
+                _SM_WCET_END(selfConst, pTransition->newState, SM_WCET_ACTION);
+            }
+            return pTransition->newState;
+        }
+        _SM_HOOK(selfConst, onGuardFail, self, pTransition->newState, pEventData);
+    }
+
+    return EVENT_IGNORED_16;
+}
+
+static void _SM_DispatchEvent(SM_StateMachine* self, BYTE eventId, void* pEventData);
+static void _SM_Step(SM_StateMachine* self, const SM_StateMachineConst* selfConst, BYTE eventId, void* pEventData);
+
+// Parks a table mode event in the deferred event FIFO, or drops it if the
+// FIFO is full
+static void _SM_Defer(SM_StateMachine* self, BYTE eventId, void* pEventData)
+{
+    // Region event data is shared and released after the fan out
+    ASSERT_TRUE(self->regions == NULL);
+
+    if (self->deferredCount == SM_DEFER_EVENTS)
+    {
+        self->deferredDropped++;
+        _SM_TRACE(self, EVENT_IGNORED_16, pEventData);
+        _SM_HOOK(self->selfConst, onIgnore, self, pEventData);
+        if (pEventData)
+            _SM_FreeEventData(self, pEventData);
+        return;
+    }
+
+    _SM_TRACE(self, SM_DEFER_16, pEventData);
+    self->deferredIds[self->deferredCount] = eventId;
+    self->deferredData[self->deferredCount] = pEventData;
+    self->deferredCount++;
+}
+
+// Runs the events deferred before the last state change, oldest first. An
+// event deferred again goes to the back of the FIFO and waits for the next
+// state change.
+static void _SM_Recall(SM_StateMachine* self)
+{
+    BYTE count = self->deferredCount;
+
+    while (count-- && self->deferredCount)
+    {
+        BYTE eventId = self->deferredIds[0];
+        void* pEventData = self->deferredData[0];
+        BYTE i;
+
+        self->deferredCount--;
+        for (i = 0; i < self->deferredCount; i++)
+        {
+            self->deferredIds[i] = self->deferredIds[i + 1];
+            self->deferredData[i] = self->deferredData[i + 1];
+        }
+
+        _SM_DispatchEvent(self, eventId, pEventData);
+    }
+}
+
+// Looks up the next state of a table mode event and generates it
+static void _SM_DispatchEvent(SM_StateMachine* self, BYTE eventId, void* pEventData)
+{
+    const SM_StateMachineConst* selfConst = self->selfConst;
+
+    ASSERT_TRUE(selfConst);
+    ASSERT_TRUE(selfConst->transitions || selfConst->transitions16 || selfConst->sparse);
+    ASSERT_TRUE(eventId < selfConst->maxEvents);
+
+    _SM_Step(self, selfConst, eventId, pEventData);
+}
+
+// Runs a checked table mode event to completion
+static void _SM_Step(SM_StateMachine* self, const SM_StateMachineConst* selfConst, BYTE eventId, void* pEventData)
+{
+    SM_StateId currentState = self->currentState;
+    SM_StateId state = currentState;
+    SM_StateId newState;
+
+    self->eventId = eventId;
+    newState = _SM_Lookup(selfConst, &state, eventId);
+#ifdef USE_SM_COVERAGE
+    // Count the cell that handles the event, a superstate's for an inherited
+    // event. The counters are shared by instances running in any context.
+    __atomic_fetch_add(&selfConst->coverage[((UINT)state * selfConst->maxEvents) + eventId], 1, __ATOMIC_RELAXED);
+#endif
+    if (newState == SM_DEFER_16)
+    {
+        _SM_Defer(self, eventId, pEventData);
+        return;
+    }
+    if (newState == SM_GUARDED_16)
+        newState = _SM_Guarded(self, selfConst, state, eventId, pEventData);
+
+    _SM_ExternalEvent(self, selfConst, newState, pEventData);
+
+    // Deferred events are recalled once the state changes
+    if (self->deferredCount && self->currentState != currentState)
+        _SM_Recall(self);
+}
+
+// Runs a table mode event in every orthogonal region of the state machine.
+// Each region's machine, state, instance data and trace ID are swapped into
+// the instance while the region runs the event.
+static void _SM_DispatchRegions(SM_StateMachine* self, BYTE eventId, void* pEventData)
+{
+    const CHAR* name = self->name;
+    void* pInstance = self->pInstance;
+    BYTE traceId = self->traceId;
+    BYTE profileId = self->profileId;
+    BYTE region;
+
+    self->pRegionData = pEventData;
+
+    for (region = 0; region < self->regionCount; region++)
+    {
+        SM_Region* pRegion = &self->regions[region];
+
+        ASSERT_TRUE(pRegion->selfConst);
+
+        self->selfConst = pRegion->selfConst;
+        self->name = pRegion->selfConst->name;
+        if (pRegion->pInstance)
+            self->pInstance = pRegion->pInstance;
+        self->currentState = pRegion->currentState;
+        self->traceId = pRegion->traceId;
+        self->profileId = pRegion->profileId;
+        memcpy(self->history, pRegion->history, sizeof(self->history));
+
+        _SM_DispatchEvent(self, eventId, pEventData);
+
+        pRegion->currentState = self->currentState;
+        pRegion->traceId = self->traceId;
+        pRegion->profileId = self->profileId;
+        memcpy(pRegion->history, self->history, sizeof(self->history));
+        self->pInstance = pInstance;
+    }
+
+    self->selfConst = NULL;
+    self->name = name;
+    self->traceId = traceId;
+    self->profileId = profileId;
+    self->pRegionData = NULL;
+
+    if (pEventData)
+        _SM_FreeEventData(self, pEventData);
+}
+
+// Runs queued events until the queue is empty
+static UINT _SM_RunQueue(SM_StateMachine* self)
+{
+    SM_EventEntry entry;
+    UINT count = 0;
+
+    while (_SM_Pop(self, &entry))
+    {
+        if (entry.pEventFunc)
+        {
+            self->eventId = SM_TRACE_EVENT_FUNC;
+            entry.pEventFunc(self, entry.pEventData);
+        }
+        else if (self->regions)
+            _SM_DispatchRegions(self, entry.eventId, entry.pEventData);
+        else
+            _SM_DispatchEvent(self, entry.eventId, entry.pEventData);
+        count++;
+    }
+
+    return count;
+}
+
+// Acquires the state machine for the caller according to its lock policy.
+// Returns FALSE if the state machine is busy and the event must be queued
+// instead, in which case the running context will run it. A busy state
+// machine is returned with interrupts masked, so the running context can't
+// go idle before the caller queues its events with _SM_PushLocked. The
+// caller then restores the mask in *pMask.
+static BOOL _SM_Acquire(SM_StateMachine* self, SM_InterruptMask* pMask)
+{
+    BOOL acquired = TRUE;
+
+    // Each policy marks the state machine running and counts the acquisition
+    // while it holds the lock, interrupts may send events to it too
+    switch (self->lockPolicy)
+    {
+    case SM_LOCK_NONE:
+        // Only busy when sent an event from within a state function
+        if (self->running)
+        {
+            *pMask = SM_INTERRUPTS_MASK();
+            acquired = FALSE;
+        }
+        else
+        {
+            self->running = TRUE;
+            self->lockAcquired++;
+        }
+        break;
+
+    case SM_LOCK_CRITICAL:
+        *pMask = SM_INTERRUPTS_MASK();
+        if (self->running)
+        {
+            acquired = FALSE;
+        }
+        else
+        {
+            self->running = TRUE;
+            self->lockAcquired++;
+        }
+        break;
+
+    case SM_LOCK_MUTEX:
+        // Create the mutex on first use. If another task wins the race to
+        // create it, use theirs.
+        if (self->lock == NULL)
+        {
+            void* lock = SM_MUTEX_CREATE();
+            ASSERT_TRUE(lock);
+
+            SM_CRITICAL_ENTER();
+            if (self->lock == NULL)
+            {
+                self->lock = lock;
+                lock = NULL;
+            }
+            SM_CRITICAL_EXIT();
+
+            if (lock)
+                SM_MUTEX_DELETE(lock);
+        }
+
+        // Sent an event from within one of our own state functions
+        if (self->running && self->lockOwner == SM_CONTEXT_ID())
+        {
+            *pMask = SM_INTERRUPTS_MASK();
+            acquired = FALSE;
+            break;
+        }
+
+        if (SM_MUTEX_TRY_TAKE(self->lock))
+        {
+            self->lockOwner = SM_CONTEXT_ID();
+        }
+        else
+        {
+            SM_MUTEX_TAKE(self->lock);
+            self->lockOwner = SM_CONTEXT_ID();
+            self->lockContended++;
+        }
+        self->running = TRUE;
+        self->lockAcquired++;
+        break;
+
+    case SM_LOCK_TRYPOST:
+        *pMask = SM_INTERRUPTS_MASK();
+        if (self->running)
+        {
+            self->lockContended++;
+            acquired = FALSE;
+        }
+        else
+        {
+            self->running = TRUE;
+            self->lockAcquired++;
+            SM_INTERRUPTS_RESTORE(*pMask);
+        }
+        break;
+
+    default:
+        ASSERT_TRUE(FALSE);
+        break;
+    }
+
+    return acquired;
+}
+
+// Marks the state machine idle unless events were queued while it ran, in
+// which case the caller must run them and try again
+static BOOL _SM_Idle(SM_StateMachine* self)
+{
+    BOOL idle;
+
+    SM_CRITICAL_ENTER();
+    idle = (self->queueCount == 0);
+    if (idle)
+        self->running = FALSE;
+    SM_CRITICAL_EXIT();
+
+    return idle;
+}
+
+// Runs queued events, then releases the state machine acquired with
+// _SM_Acquire. Returns the number of events run.
+static UINT _SM_Release(SM_StateMachine* self, SM_InterruptMask mask)
+{
+    UINT count = 0;
+
+    do
+    {
+        count += _SM_RunQueue(self);
+    } while (!_SM_Idle(self));
+
+    switch (self->lockPolicy)
+    {
+    case SM_LOCK_CRITICAL:
+        SM_INTERRUPTS_RESTORE(mask);
+        break;
+
+    case SM_LOCK_MUTEX:
+        self->lockOwner = NULL;
+        SM_MUTEX_GIVE(self->lock);
+        break;
+
+    default:
+        break;
+    }
+
+    return count;
+}
+
+// Adds an event function or table mode event to the back of the event queue.
+// The caller masks interrupts, and frees the event data if the queue is full.
+static BOOL _SM_PushLocked(SM_StateMachine* self, SM_EventFunc pEventFunc, BYTE eventId, void* pEventData)
+{
+    BYTE tail;
+
+    if (self->queueCount >= self->queueSize)
+        return FALSE;
+
+    tail = self->queueHead + self->queueCount;
+    if (tail >= self->queueSize)
+        tail -= self->queueSize;
+
+    self->queue[tail].pEventFunc = pEventFunc;
+    self->queue[tail].pEventData = pEventData;
+    self->queue[tail].eventId = eventId;
+    self->queueCount++;
+
+    return TRUE;
+}
+
+// Adds an event function or table mode event to the back of the event queue
+static BOOL _SM_Push(SM_StateMachine* self, SM_EventFunc pEventFunc, BYTE eventId, void* pEventData)
+{
+    BOOL posted;
+
+    {
+        SM_CRITICAL_ENTER();
+        posted = _SM_PushLocked(self, pEventFunc, eventId, pEventData);
+        SM_CRITICAL_EXIT();
+    }
+
+    // The queue owns the event data, drop it along with the event
+    if (!posted && pEventData)
+        _SM_FreeEventData(self, pEventData);
+
+    return posted;
+}
+
+// Runs an event function or table mode event
+static void _SM_RunEvent(SM_StateMachine* self, SM_EventFunc pEventFunc, BYTE eventId, void* pEventData)
+{
+    if (pEventFunc)
+    {
+        self->eventId = SM_TRACE_EVENT_FUNC;
+        pEventFunc(self, pEventData);
+    }
+    else if (self->regions)
+    {
+        _SM_DispatchRegions(self, eventId, pEventData);
+    }
+    else
+    {
+        _SM_DispatchEvent(self, eventId, pEventData);
+    }
+}
+
+// Sends an event function or table mode event and runs it to completion
+// along with any events queued while it executes
+static void _SM_Send(SM_StateMachine* self, SM_EventFunc pEventFunc, BYTE eventId, void* pEventData)
+{
+    SM_InterruptMask mask = 0;
+
+    // Never re-enter a running state machine, queue the event instead
+    if (!_SM_Acquire(self, &mask))
+    {
+        BOOL posted;
+
+        // A state machine without a queue has no lock and is only busy in
+        // its own state functions, run the event nested in the current one
+        if (self->queue == NULL)
+        {
+            SM_INTERRUPTS_RESTORE(mask);
+            _SM_RunEvent(self, pEventFunc, eventId, pEventData);
+            return;
+        }
+
+        posted = _SM_PushLocked(self, pEventFunc, eventId, pEventData);
+        SM_INTERRUPTS_RESTORE(mask);
+
+        // The queue owns the event data, drop it along with the event
+        if (!posted && pEventData)
+            _SM_FreeEventData(self, pEventData);
+        return;
+    }
+
+    _SM_RunEvent(self, pEventFunc, eventId, pEventData);
+
+    _SM_Release(self, mask);
+}
+
+// Sends an external event and runs it to completion along with any events
+// queued while it executes
+void _SM_Event(SM_StateMachine* self, SM_EventFunc pEventFunc, void* pEventData)
+{
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(pEventFunc);
+    ASSERT_TRUE(self->regions == NULL);
+
+    _SM_Send(self, pEventFunc, 0, pEventData);
+}
+
+// Sends a table mode event and runs it to completion along with any events
+// queued while it executes
+void _SM_Dispatch(SM_StateMachine* self, BYTE eventId, void* pEventData)
+{
+    ASSERT_TRUE(self);
+
+    _SM_Send(self, NULL, eventId, pEventData);
+}
+
+// Sends a batch of table mode events and runs them to completion in order,
+// along with any events queued while they execute
+UINT _SM_EventBatch(SM_StateMachine* self, const SM_BatchEvent* events, UINT count, SM_BatchStats* pStats)
+{
+    const SM_StateMachineConst* selfConst;
+    SM_BatchStats stats = { 0 };
+    SM_InterruptMask mask = 0;
+    BOOL acquired;
+    UINT i;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(events || count == 0);
+
+    // Check the whole batch up front, region events are checked as each
+    // region runs them
+    selfConst = self->selfConst;
+    if (!self->regions)
+    {
+        ASSERT_TRUE(selfConst);
+        ASSERT_TRUE(selfConst->transitions || selfConst->transitions16 || selfConst->sparse);
+        for (i = 0; i < count; i++)
+            ASSERT_TRUE(events[i].eventId < selfConst->maxEvents);
+    }
+
+    acquired = _SM_Acquire(self, &mask);
+    if (!acquired && self->queue)
+    {
+        // Busy, the running context runs the batch. Once the queue is full
+        // the rest of the batch is dropped.
+        while (stats.queued < count &&
+            _SM_PushLocked(self, NULL, events[stats.queued].eventId, events[stats.queued].pEventData))
+        {
+            stats.queued++;
+        }
+        SM_INTERRUPTS_RESTORE(mask);
+
+        for (i = stats.queued; i < count; i++)
+        {
+            if (events[i].pEventData)
+                _SM_FreeEventData(self, events[i].pEventData);
+            stats.dropped++;
+        }
+    }
+    else
+    {
+        // A state machine without a queue runs the batch nested in its own
+        // state function, see _SM_Send
+        if (!acquired)
+            SM_INTERRUPTS_RESTORE(mask);
+
+        for (i = 0; i < count; i++)
+        {
+            SM_StateId currentState = self->currentState;
+
+            if (self->regions)
+                _SM_DispatchRegions(self, events[i].eventId, events[i].pEventData);
+            else
+                _SM_Step(self, selfConst, events[i].eventId, events[i].pEventData);
+
+            stats.dispatched++;
+            if (self->currentState != currentState)
+                stats.changes++;
+        }
+
+        if (acquired)
+            stats.queueRun = (UINT16)_SM_Release(self, mask);
+    }
+
+    if (pStats)
+        *pStats = stats;
+
+    return stats.dispatched + stats.queued;
+}
+
+// Adds an external event to the back of the event queue
+BOOL _SM_Post(SM_StateMachine* self, SM_EventFunc pEventFunc, void* pEventData)
+{
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(pEventFunc);
+    ASSERT_TRUE(self->regions == NULL);
+
+    return _SM_Push(self, pEventFunc, 0, pEventData);
+}
+
+// Adds a table mode event to the back of the event queue
+BOOL _SM_PostId(SM_StateMachine* self, BYTE eventId, void* pEventData)
+{
+    ASSERT_TRUE(self);
+
+    return _SM_Push(self, NULL, eventId, pEventData);
+}
+
+// Adds an external event with a copy of the caller's event data to the back
+// of the event queue
+BOOL _SM_PostCopy(SM_StateMachine* self, SM_EventFunc pEventFunc, const void* pEventData, size_t size)
+{
+    void* pCopy = _SM_CopyEventData(self, pEventData, size);
+
+    if (pCopy == NULL)
+        return FALSE;
+
+    return _SM_Post(self, pEventFunc, pCopy);
+}
+
+// Runs queued events to completion until the queue is empty
+UINT _SM_Run(SM_StateMachine* self)
+{
+    SM_InterruptMask mask = 0;
+
+    ASSERT_TRUE(self);
+
+    // If the state machine is busy its current owner runs the queue
+    if (!_SM_Acquire(self, &mask))
+    {
+        SM_INTERRUPTS_RESTORE(mask);
+        return 0;
+    }
+
+    return _SM_Release(self, mask);
+}
+
+// Runs the current state function again without event data, along with any
+// events queued while it executes
+BOOL _SM_Reenter(SM_StateMachine* self)
+{
+    SM_InterruptMask mask = 0;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(self->selfConst);
+    ASSERT_TRUE(self->regions == NULL);
+
+    if (!_SM_Acquire(self, &mask))
+    {
+        SM_INTERRUPTS_RESTORE(mask);
+        return FALSE;
+    }
+
+    self->eventId = SM_TRACE_EVENT_INTERNAL;
+    _SM_ExternalEvent(self, self->selfConst, self->currentState, NULL);
+
+    _SM_Release(self, mask);
+    return TRUE;
+}
@@ -4,7 +4,125 @@
 // machine (FSM).
 //
 // All event data must be created dynamically using SM_XAlloc. Use a fixed 
-// block allocator or the heap as desired. 
+// block allocator or the heap as desired. Alternatively send the event with
+// SM_EventCopy, which copies small event data into a slot embedded in the
+// state machine instance and only allocates when the data does not fit.
+//
+// A state machine defined with SM_DEFINE_QUEUE owns a bounded event queue.
+// Events are queued with SM_Post and run by SM_Run, one at a time and each
+// to completion. An event sent to a state machine that is already running,
+// for instance from within one of its own state functions, is queued and
+// run after the current event completes. Posting is safe from any task or
+// interrupt. A state machine defined with SM_DEFINE has no queue, and runs
+// an event sent from within one of its own state functions at once, nested
+// in the current event.
+//
+// Interrupts that send table mode events can post them instead to an event
+// ring, see sm_ring.h, which queues without masking interrupts and is run
+// by one consumer task. Events that take no more than a cycle budget may
+// instead run at once in the interrupt with SM_RingDispatch.
+//
+// In table mode a state machine's transitions are one dense const table
+// with a row per state and a column per event, see BEGIN_TRANSITION_TABLE.
+// Events are then small integer IDs sent with SM_Dispatch or SM_PostId, and
+// the next state is a single table load. A state machine using table mode is
+// defined with SM_DEFINE_TABLE and needs no event functions.
+//
+// SM_MACHINE_TABLE defines a table mode state machine from a single list of
+// its states, see SM_X_STATE_ENUM. The state enumeration, state function
+// declarations, state map, name strings and transition table are all
+// generated from that list and checked for consistency at compile time.
+//
+// SM_MACHINE_HSM defines a hierarchical table mode state machine. States may
+// have a parent superstate. A child's transition table cell SM_INHERIT defers
+// the event to its superstates, and a transition runs the exit actions from
+// the current state up to the least common ancestor of the current and new
+// states, then the entry actions down to the new state. A superstate with
+// history remembers the substate it was left from, and a transition to the
+// superstate resumes that substate instead of running the superstate's own
+// state function. Shallow history resumes the direct substate, deep history
+// the innermost one. A superstate left while it is the current state has no
+// substate to resume, and runs its own state function again. History is
+// kept until a state function calls SM_ClearHistory, e.g. the state that
+// re-initializes the machine.
+//
+// SM_DEFINE_REGIONS defines a state machine instance with orthogonal
+// regions, each running its own table mode state machine with its own
+// current state. A table mode event dispatched to the instance is run by
+// every region in turn, in region order, and the whole fan out is one run to
+// completion step. The region machines share the instance's event IDs, lock
+// and event queue, so independent concerns need no task or queue of their
+// own. Region machines can't defer events.
+//
+// Define USE_SM_SWITCH_ENGINE, for the build or before StateMachine.h is
+// first included in the file defining a machine, to have SM_MACHINE_TABLE
+// and SM_MACHINE_HSM also generate a state engine for the machine. The
+// generated engine runs the state functions from one switch statement
+// instead of calling them through the state map, so the compiler can inline
+// them and a chain of automatic transitions runs as jumps within one
+// function. Behaviour is the same as the standard engine.
+//
+// SM_EventBatch sends an array of table mode events at once. The state
+// machine is acquired and checked once for the whole batch, which then runs
+// as one burst of run to completion steps. Per batch statistics are returned
+// in an SM_BatchStats.
+//
+// A table mode transition table cell SM_DEFER parks the event in a small
+// FIFO in the state machine instance instead of ignoring it. Deferred events
+// are recalled, oldest first, as soon as an event changes the current
+// state, and run in the new state, which may defer them again. Deferral
+// needs no allocation: the FIFO holds SM_DEFER_EVENTS events, an event
+// deferred while it is full is dropped like an ignored event.
+//
+// State IDs are 16 bit. A table mode machine's transition table cells are
+// normally one byte, which is enough for 251 states. A machine with more
+// states is defined with SM_MACHINE_TABLE16 and has a table of UINT16 cells
+// using the _16 sentinels, e.g. EVENT_IGNORED_16. Event IDs stay 8 bit.
+//
+// SM_MACHINE_SPARSE defines a table mode machine whose transition table is
+// stored row displaced instead of dense, for large machines whose rows are
+// mostly EVENT_IGNORED. Each row keeps only the cells that differ from its
+// most common cell, overlaid with the other rows in one cell array, and a
+// lookup is still a few loads. tools/sm_gen.py --sparse emits the row
+// displaced lists next to the state list.
+//
+// A table mode transition table cell SM_GUARDED makes the event a choice
+// between guarded transitions, listed with the machine, see
+// SM_MACHINE_GUARDED. Each guarded transition of the state and event has
+// an optional guard and action, and the first whose guard passes, or that
+// has no guard, is taken: its action runs, then the transition to its new
+// state. The event is ignored if every guard fails. A decision that would
+// otherwise need a transient state raising internal events is made in the
+// one dispatch.
+//
+// Define USE_SM_TRACE to record every transition into the binary trace ring
+// of sm_trace.h.
+//
+// Define USE_SM_HOOKS to call the instrumentation hooks of a machine, see
+// SM_Hooks, on each transition, ignored event, failed guard and state entry
+// and exit. The hooks of a machine are chosen when it is defined: each
+// machine definition macro uses SM_HOOKS, SM_NoHooks unless defined to the
+// address of another SM_Hooks before the machine is defined. A generated
+// state engine resolves the hooks at compile time, so SM_NoHooks costs
+// nothing there, the shared engines make an empty call. Without
+// USE_SM_HOOKS no hook is called at all. SM_LogHooks logs the transitions
+// of the instances of a machine defined with SM_DEFINE_VERBOSE.
+//
+// Define USE_SM_PROFILE to count state entries, state residency and state
+// function cycles per state, see sm_profile.h.
+//
+// Define USE_SM_COVERAGE to count how often each transition table cell of a
+// table mode machine is hit, including ignored and CANNOT_HAPPEN cells, see
+// sm_coverage.h.
+//
+// Define USE_SM_WCET to time every state function, guard, action, entry and
+// exit action the state engines call, and every run to completion step,
+// for their worst case execution time, see sm_wcet.h. The profile and the
+// timings both build with sm_cycles.c, and count from SM_PORT_INIT.
+//
+// SM_DEFINE_LOCKED selects how a state machine is protected when events are
+// sent to it from more than one context, see SM_LockPolicy. Without a lock
+// SM_Event and SM_Run must only be called from one context.
 //
 // The standard version (non-EX) supports state and event functions. The 
 // extended version (EX) supports the additional guard, entry and exit state
@@ -15,13 +133,47 @@
 #ifndef _STATE_MACHINE_H
 #define _STATE_MACHINE_H
 
+#include <stddef.h>
 #include "DataTypes.h"
 #include "Fault.h"
+#include "sm_port.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Times a state function call for the profile, see sm_profile.h
+#ifdef USE_SM_PROFILE
+    #include "sm_profile.h"
+    #define _SM_PROFILE_BEGIN()     UINT32 _smCycles = SM_CYCLES()
+    #define _SM_PROFILE_END(_self_) \
+        SM_ProfileRun((_self_)->profileId, (_self_)->currentState, SM_CYCLES() - _smCycles)
+#else
+    #define _SM_PROFILE_BEGIN()
+    #define _SM_PROFILE_END(_self_)
+#endif
+
+// Times a call for its worst case execution time, see sm_wcet.h. A run to
+// completion step also counts the state functions it runs.
+#ifdef USE_SM_WCET
+    #include "sm_wcet.h"
+    #define _SM_WCET_BEGIN()        UINT32 _smWcet = SM_CYCLES()
+    #define _SM_WCET_END(_selfConst_, _state_, _kind_) \
+        SM_WcetRecord((_selfConst_)->wcet, _state_, _kind_, SM_CYCLES() - _smWcet)
+    #define _SM_WCET_STATE_END(_self_, _selfConst_) \
+        ((_self_)->chainLength++, _SM_WCET_END(_selfConst_, (_self_)->currentState, SM_WCET_STATE))
+    #define _SM_WCET_CHAIN_BEGIN(_self_) \
+        UINT32 _smWcetChain = ((_self_)->chainLength = 0, SM_CYCLES())
+    #define _SM_WCET_CHAIN_END(_self_, _selfConst_) \
+        SM_WcetChain((_selfConst_)->wcet, (_self_)->chainLength, SM_CYCLES() - _smWcetChain)
+#else
+    #define _SM_WCET_BEGIN()
+    #define _SM_WCET_END(_selfConst_, _state_, _kind_)
+    #define _SM_WCET_STATE_END(_self_, _selfConst_)
+    #define _SM_WCET_CHAIN_BEGIN(_self_)
+    #define _SM_WCET_CHAIN_END(_self_, _selfConst_)
+#endif
+
 // Define USE_SM_ALLOCATOR to use the fixed block allocator instead of heap
 //#define USE_SM_ALLOCATOR
 #ifdef USE_SM_ALLOCATOR
@@ -34,36 +186,277 @@ extern "C" {
     #define SM_XFree(ptr)      vPortFree(ptr)
 #endif
 
-enum { EVENT_IGNORED = 0xFE, CANNOT_HAPPEN = 0xFF };
+// Size in bytes of the event data slot embedded in each state machine
+// instance. Event data sent with SM_EventCopy that fits is copied here.
+#ifndef SM_EVENT_DATA_SIZE
+#define SM_EVENT_DATA_SIZE      16
+#endif
+
+enum { SM_GUARDED = 0xFB, SM_DEFER = 0xFC, SM_INHERIT = 0xFD, EVENT_IGNORED = 0xFE, CANNOT_HAPPEN = 0xFF };
+
+// Sentinels of 16 bit transition tables, see SM_MACHINE_TABLE16. The state
+// engines work with these, byte cells are widened with _SM_STATE_ID.
+enum { SM_GUARDED_16 = 0xFFFB, SM_DEFER_16 = 0xFFFC, SM_INHERIT_16 = 0xFFFD, EVENT_IGNORED_16 = 0xFFFE, CANNOT_HAPPEN_16 = 0xFFFF };
+
+// A state ID, or one of the _16 sentinels
+typedef UINT16 SM_StateId;
+
+// Widens a byte transition cell to a state ID, keeping its sentinel
+#define _SM_STATE_ID(_cell_) \
+    ((_cell_) >= SM_GUARDED ? (SM_StateId)((_cell_) | 0xFF00) : (SM_StateId)(_cell_))
+
+// Deferred events each state machine instance can hold
+#ifndef SM_DEFER_EVENTS
+#define SM_DEFER_EVENTS         2
+#endif
+
+// Deepest superstate nesting of a hierarchical state machine
+#ifndef SM_HSM_MAX_DEPTH
+#define SM_HSM_MAX_DEPTH        8
+#endif
+
+// Superstates with history per hierarchical state machine instance
+#ifndef SM_HSM_HISTORY_SLOTS
+#define SM_HSM_HISTORY_SLOTS    2
+#endif
+
+// History of a superstate, combined with its history slot number
+enum { SM_HISTORY_SHALLOW = 0x40, SM_HISTORY_DEEP = 0x80 };
+#define SM_HISTORY_SLOT         0x3F
+
+// How a state machine is protected while it runs an event
+typedef enum
+{
+    // No protection, events are only sent from one context
+    SM_LOCK_NONE,
+    // Events run with interrupts masked. State functions must be short.
+    SM_LOCK_CRITICAL,
+    // Events run holding a mutex, other senders block. Task context only.
+    SM_LOCK_MUTEX,
+    // The first sender runs the event. Concurrent senders queue their event
+    // and return, the running sender runs it before returning. Needs a queue.
+    SM_LOCK_TRYPOST
+} SM_LockPolicy;
 
 typedef void NoEventData;
 
+struct SM_StateMachine;
+
+// Cell of a row displaced transition table not used by any row
+enum { SM_SPARSE_FREE = 0xFF };
+
+// Row displaced transition table, see SM_MACHINE_SPARSE. The cell of state
+// s and event e is at base[s] + e if check[] there holds e, otherwise it is
+// the row default of s. Rows have distinct bases, so a cell of another row
+// at the same place never holds e.
+typedef struct SM_SparseTable
+{
+    const UINT16* base;         // Offset of each state's row in the cells
+    const BYTE* defaults;       // Cell of the events of each state without their own cell
+    const BYTE* check;          // Event ID of each cell, or SM_SPARSE_FREE
+    const BYTE* next;           // Transition table cell of each cell
+    UINT16 cells;
+} SM_SparseTable;
+
 // State machine constant data
-typedef struct
+typedef struct SM_StateMachineConst
 {
     const CHAR* name;
-    const BYTE maxStates;
+    const UINT16 maxStates;
     const struct SM_StateStruct* stateMap;
     const struct SM_StateStructEx* stateMapEx;
+    const BYTE maxEvents;
+    const BYTE* transitions;
+    const CHAR* const* stateNames;
+    const CHAR* const* eventNames;
+    const BYTE* parents;
+    const struct SM_HsmActions* actions;
+    const BYTE* history;
+    void (*engine)(struct SM_StateMachine* self);
+    UINT32* coverage;
+    const struct SM_Hooks* hooks;
+    const UINT16* transitions16;
+    const SM_SparseTable* sparse;
+    const struct SM_GuardedTransition* guarded;
+    UINT16 guardedCount;
+    struct SM_WcetTable* wcet;
 } SM_StateMachineConst;
 
+struct SM_EventEntry;
+struct SM_Region;
+
 // State machine instance data
-typedef struct 
+typedef struct SM_StateMachine
 {
     const CHAR* name;
     void* pInstance;
-    BYTE newState;
-    BYTE currentState;
+    SM_StateId newState;
+    SM_StateId currentState;
     BOOL eventGenerated;
     void* pEventData;
     BOOL verbose;
+    BOOL eventDataBusy;
+    union
+    {
+        BYTE bytes[SM_EVENT_DATA_SIZE];
+        void* align;
+    } eventData;
+    struct SM_EventEntry* queue;
+    BYTE queueSize;
+    BYTE queueHead;
+    BYTE queueCount;
+    BOOL running;
+    BYTE lockPolicy;
+    void* lock;
+    void* lockOwner;
+    UINT32 lockAcquired;
+    UINT32 lockContended;
+    const SM_StateMachineConst* selfConst;
+    BYTE traceId;
+    BYTE eventId;
+    UINT16 eventDataSize;
+    struct SM_Region* regions;
+    BYTE regionCount;
+    void* pRegionData;
+    SM_StateId history[SM_HSM_HISTORY_SLOTS];
+    void* deferredData[SM_DEFER_EVENTS];
+    BYTE deferredIds[SM_DEFER_EVENTS];
+    BYTE deferredCount;
+    UINT16 deferredDropped;
+    BYTE profileId;
+    UINT16 chainLength;
 } SM_StateMachine;
 
+// An orthogonal region of a state machine instance, see SM_DEFINE_REGIONS
+typedef struct SM_Region
+{
+    const SM_StateMachineConst* selfConst;
+    void* pInstance;
+    SM_StateId currentState;
+    BYTE traceId;
+    SM_StateId history[SM_HSM_HISTORY_SLOTS];
+    BYTE profileId;
+} SM_Region;
+
+// Instrumentation hooks of a machine, see USE_SM_HOOKS. Every hook must be
+// set, to one of the SM_No*Hook functions if it isn't needed. Hooks must not
+// send events or call SM_InternalEvent.
+typedef struct SM_Hooks
+{
+    // The machine switches from state from to state to, which may be the same
+    void (*onTransition)(struct SM_StateMachine* self, SM_StateId from, SM_StateId to, void* pEventData);
+    // An event is ignored in the current state
+    void (*onIgnore)(struct SM_StateMachine* self, void* pEventData);
+    // The guard of state newState rejects an event
+    void (*onGuardFail)(struct SM_StateMachine* self, SM_StateId newState, void* pEventData);
+    // The machine enters state, after leaving the states it exits
+    void (*onEntry)(struct SM_StateMachine* self, SM_StateId state);
+    // The machine leaves state
+    void (*onExit)(struct SM_StateMachine* self, SM_StateId state);
+} SM_Hooks;
+
+// Hooks that do nothing
+static inline void SM_NoTransitionHook(struct SM_StateMachine* self, SM_StateId from, SM_StateId to, void* pEventData)
+{
+    (void)self; (void)from; (void)to; (void)pEventData;
+}
+
+static inline void SM_NoIgnoreHook(struct SM_StateMachine* self, void* pEventData)
+{
+    (void)self; (void)pEventData;
+}
+
+static inline void SM_NoGuardFailHook(struct SM_StateMachine* self, SM_StateId newState, void* pEventData)
+{
+    (void)self; (void)newState; (void)pEventData;
+}
+
+static inline void SM_NoEntryHook(struct SM_StateMachine* self, SM_StateId state)
+{
+    (void)self; (void)state;
+}
+
+static inline void SM_NoExitHook(struct SM_StateMachine* self, SM_StateId state)
+{
+    (void)self; (void)state;
+}
+
+// Hooks of machines without instrumentation
+static const SM_Hooks SM_NoHooks = { SM_NoTransitionHook, SM_NoIgnoreHook, SM_NoGuardFailHook,
+    SM_NoEntryHook, SM_NoExitHook };
+
+// Hooks of the machines defined from here on, see USE_SM_HOOKS
+#ifndef SM_HOOKS
+#define SM_HOOKS                &SM_NoHooks
+#endif
+
+// Hooks that log transitions, ignored events and failed guards of instances
+// defined with SM_DEFINE_VERBOSE
+extern const SM_Hooks SM_LogHooks;
+
+// Calls hook _hook_ of a machine
+#ifdef USE_SM_HOOKS
+#define _SM_HOOK(_selfConst_, _hook_, ...) \
+    ((_selfConst_)->hooks->_hook_(__VA_ARGS__))
+#else
+#define _SM_HOOK(_selfConst_, _hook_, ...)
+#endif
+
+// Traces a transition, see sm_trace.h
+#ifdef USE_SM_TRACE
+void _SM_TraceTransition(SM_StateMachine* self, SM_StateId newState, void* pEventData);
+#define _SM_TRACE(_self_, _newState_, _pEventData_) \
+    _SM_TraceTransition(_self_, _newState_, _pEventData_)
+#else
+#define _SM_TRACE(_self_, _newState_, _pEventData_)
+#endif
+
 // Generic state function signatures
 typedef void (*SM_StateFunc)(SM_StateMachine* self, void* pEventData);
 typedef BOOL (*SM_GuardFunc)(SM_StateMachine* self, void* pEventData);
 typedef void (*SM_EntryFunc)(SM_StateMachine* self, void* pEventData);
 typedef void (*SM_ExitFunc)(SM_StateMachine* self);
+typedef void (*SM_EventFunc)(SM_StateMachine* self, void* pEventData);
+typedef void (*SM_ActionFunc)(SM_StateMachine* self, void* pEventData);
+
+// A guarded transition of a table mode machine, taken for an SM_GUARDED
+// cell. The guarded transitions of a state and event are consecutive and
+// tried in order.
+typedef struct SM_GuardedTransition
+{
+    SM_StateId state;
+    BYTE eventId;
+    SM_GuardFunc guard;         // Transition taken if it passes, or NULL
+    SM_ActionFunc action;       // Run before the transition, or NULL
+    SM_StateId newState;
+} SM_GuardedTransition;
+
+// An external event waiting in a state machine's event queue. Table mode
+// events have no event function and are identified by eventId.
+typedef struct SM_EventEntry
+{
+    SM_EventFunc pEventFunc;
+    void* pEventData;
+    BYTE eventId;
+} SM_EventEntry;
+
+// A table mode event of a batch, see SM_EventBatch
+typedef struct
+{
+    BYTE eventId;
+    void* pEventData;
+} SM_BatchEvent;
+
+// Statistics of one batch
+typedef struct
+{
+    UINT16 dispatched;          // Events run by the batch
+    UINT16 changes;             // Events that changed the current state, of
+                                // the last region for regions
+    UINT16 queued;              // Events queued as the state machine was busy
+    UINT16 dropped;             // Events dropped as the queue was full
+    UINT16 queueRun;            // Events queued by others run after the batch
+} SM_BatchStats;
 
 typedef struct SM_StateStruct
 {
@@ -78,32 +471,235 @@ typedef struct SM_StateStructEx
     SM_ExitFunc pExitFunc;
 } SM_StateStructEx;
 
+// Entry and exit actions of a hierarchical state machine state
+typedef struct SM_HsmActions
+{
+    SM_EntryFunc pEntryFunc;
+    SM_ExitFunc pExitFunc;
+} SM_HsmActions;
+
 // Public functions
 #define SM_Event(_smName_, _eventFunc_, _eventData_) \
-    _eventFunc_(&_smName_##Obj, _eventData_)
+    _SM_Event(&_smName_##Obj, (SM_EventFunc)_eventFunc_, _eventData_)
+
+// Send an event with a copy of the caller's event data. The data is placed
+// in the instance's event data slot when it fits and the slot is free,
+// otherwise it is copied to a block from SM_XAlloc. The event is dropped if
+// that allocation fails.
+#define SM_EventCopy(_smName_, _eventFunc_, _eventData_) \
+    do { \
+        void* _pCopy = _SM_CopyEventData(&_smName_##Obj, _eventData_, sizeof(*(_eventData_))); \
+        if (_pCopy) \
+            _SM_Event(&_smName_##Obj, (SM_EventFunc)_eventFunc_, _pCopy); \
+    } while (0)
+
+// Queue an event to be run by SM_Run. Evaluates to FALSE, and releases the
+// event data, if the queue is full.
+#define SM_Post(_smName_, _eventFunc_, _eventData_) \
+    _SM_Post(&_smName_##Obj, (SM_EventFunc)_eventFunc_, _eventData_)
+
+// Queue an event with a copy of the caller's event data, see SM_EventCopy
+#define SM_PostCopy(_smName_, _eventFunc_, _eventData_) \
+    _SM_PostCopy(&_smName_##Obj, (SM_EventFunc)_eventFunc_, _eventData_, sizeof(*(_eventData_)))
+
+// Send a table mode event, see SM_Event
+#define SM_Dispatch(_smName_, _eventId_, _eventData_) \
+    _SM_Dispatch(&_smName_##Obj, _eventId_, _eventData_)
+
+// Send a table mode event with a copy of the caller's event data, see
+// SM_EventCopy
+#define SM_DispatchCopy(_smName_, _eventId_, _eventData_) \
+    do { \
+        void* _pCopy = _SM_CopyEventData(&_smName_##Obj, _eventData_, sizeof(*(_eventData_))); \
+        if (_pCopy) \
+            _SM_Dispatch(&_smName_##Obj, _eventId_, _pCopy); \
+    } while (0)
+
+// Send an array of table mode events and run them in order, see
+// SM_Dispatch. Event data must be allocated as for SM_Dispatch. If the state
+// machine is busy the events are queued instead. Interrupts stay masked for
+// the whole batch with SM_LOCK_CRITICAL. _pStats_ may be NULL. Evaluates to
+// the number of events run or queued.
+#define SM_EventBatch(_smName_, _events_, _count_, _pStats_) \
+    _SM_EventBatch(&_smName_##Obj, _events_, _count_, _pStats_)
+
+// Queue a table mode event, see SM_Post
+#define SM_PostId(_smName_, _eventId_, _eventData_) \
+    _SM_PostId(&_smName_##Obj, _eventId_, _eventData_)
+
+// Current state of region _region_ of a state machine defined with
+// SM_DEFINE_REGIONS
+#define SM_RegionState(_smName_, _region_) \
+    (_smName_##Regions[_region_].currentState)
+
+// Run queued events until the queue is empty. Evaluates to the number of
+// events run.
+#define SM_Run(_smName_) \
+    _SM_Run(&_smName_##Obj)
+
+// Run the current state function again without event data, e.g. to restore
+// the outputs of a state machine restored from a snapshot, see
+// sm_snapshot.h. Entry actions are not run. Evaluates to FALSE if the state
+// machine is busy.
+#define SM_Reenter(_smName_) \
+    _SM_Reenter(&_smName_##Obj)
 
 // Protected functions
 #define SM_InternalEvent(_newState_, _eventData_) \
     _SM_InternalEvent(self, _newState_, _eventData_)
 #define SM_GetInstance(_instance_) \
     (_instance_*)(self->pInstance);
+#define SM_ClearHistory() \
+    _SM_ClearHistory(self)
 
 // Private functions
-void _SM_ExternalEvent(SM_StateMachine* self, const SM_StateMachineConst* selfConst, BYTE newState, void* pEventData);
-void _SM_InternalEvent(SM_StateMachine* self, BYTE newState, void* pEventData);
+void _SM_ExternalEvent(SM_StateMachine* self, const SM_StateMachineConst* selfConst, SM_StateId newState, void* pEventData);
 void _SM_StateEngine(SM_StateMachine* self, const SM_StateMachineConst* selfConst);
 void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfConst);
+void* _SM_StateEnter(SM_StateMachine* self, const SM_StateMachineConst* selfConst);
+void* _SM_CopyEventData(SM_StateMachine* self, const void* pEventData, size_t size);
+void _SM_FreeEventData(SM_StateMachine* self, void* pEventData);
+void _SM_Event(SM_StateMachine* self, SM_EventFunc pEventFunc, void* pEventData);
+BOOL _SM_Post(SM_StateMachine* self, SM_EventFunc pEventFunc, void* pEventData);
+BOOL _SM_PostCopy(SM_StateMachine* self, SM_EventFunc pEventFunc, const void* pEventData, size_t size);
+void _SM_Dispatch(SM_StateMachine* self, BYTE eventId, void* pEventData);
+BOOL _SM_PostId(SM_StateMachine* self, BYTE eventId, void* pEventData);
+UINT _SM_EventBatch(SM_StateMachine* self, const SM_BatchEvent* events, UINT count, SM_BatchStats* pStats);
+UINT _SM_Run(SM_StateMachine* self);
+BOOL _SM_Reenter(SM_StateMachine* self);
+
+// Generates an internal event. Called from within a state function to
+// transition to a new state. Inline so a generated state engine can fold
+// automatic transitions.
+static inline void _SM_InternalEvent(SM_StateMachine* self, SM_StateId newState, void* pEventData)
+{
+    ASSERT_TRUE(self);
+
+    self->pEventData = pEventData;
+    self->eventGenerated = TRUE;
+    self->newState = newState;
+}
+
+// Forgets the substates the superstates with history were left from, of the
+// running state machine or region. Called from within a state function.
+static inline void _SM_ClearHistory(SM_StateMachine* self)
+{
+    UINT slot;
+
+    ASSERT_TRUE(self);
+
+    for (slot = 0; slot < SM_HSM_HISTORY_SLOTS; slot++)
+        self->history[slot] = 0;
+}
+
+// Reads the transition table cell of a state and event of a table mode
+// machine, whatever the width of its table
+static inline SM_StateId _SM_TableCell(const SM_StateMachineConst* selfConst, SM_StateId state, BYTE eventId)
+{
+    const UINT cell = ((UINT)state * selfConst->maxEvents) + eventId;
+
+    if (selfConst->transitions)
+        return _SM_STATE_ID(selfConst->transitions[cell]);
+    if (selfConst->transitions16)
+        return selfConst->transitions16[cell];
+    {
+        const SM_SparseTable* sparse = selfConst->sparse;
+        const UINT index = (UINT)sparse->base[state] + eventId;
+
+        if (sparse->check[index] == eventId)
+            return _SM_STATE_ID(sparse->next[index]);
+        return _SM_STATE_ID(sparse->defaults[state]);
+    }
+}
+
+// Makes the new state current, through the trace, transition hook and
+// profile every state engine switches states through
+static inline void _SM_Switch(SM_StateMachine* self, const SM_StateMachineConst* selfConst, void* pEventData)
+{
+    (void)selfConst;
+    (void)pEventData;
+
+    _SM_TRACE(self, self->newState, pEventData);
+    _SM_HOOK(selfConst, onTransition, self, self->currentState, self->newState, pEventData);
+#ifdef USE_SM_PROFILE
+    SM_ProfileEnter(&self->profileId, self->name, self->currentState, self->newState);
+#endif
+    self->currentState = self->newState;
+}
+
+// Switches a generated state engine to the new state, see _SM_StateEnter.
+// Machines without superstates or history switch inline.
+static inline void* _SM_StateEnterInline(SM_StateMachine* self, const SM_StateMachineConst* selfConst)
+{
+    if (!selfConst->parents && !selfConst->history)
+    {
+        void* pEventData = self->pEventData;
+
+        ASSERT_TRUE(self->newState < selfConst->maxStates);
+
+        self->pEventData = NULL;
+        self->eventGenerated = FALSE;
+#ifdef USE_SM_HOOKS
+        if (self->newState != self->currentState)
+        {
+            _SM_HOOK(selfConst, onExit, self, self->currentState);
+            _SM_HOOK(selfConst, onEntry, self, self->newState);
+        }
+#endif
+        _SM_Switch(self, selfConst, pEventData);
+        return pEventData;
+    }
+    return _SM_StateEnter(self, selfConst);
+}
 
 #define SM_DECLARE(_smName_) \
     extern SM_StateMachine _smName_##Obj; 
 
+// Declares the constant data of a table mode state machine so instances
+// can be defined outside the file that defines the state machine
+#define SM_DECLARE_CONST(_smName_) \
+    extern const SM_StateMachineConst _smName_##Const;
+
 #define SM_DEFINE(_smName_, _instance_) \
     SM_StateMachine _smName_##Obj = { #_smName_, _instance_, \
-        0, 0, 0, 0, 0 };
+        0, 0, 0, 0, 0, 0, { { 0 } } };
 
 #define SM_DEFINE_VERBOSE(_smName_, _instance_) \
     SM_StateMachine _smName_##Obj = { #_smName_, _instance_, \
-        0, 0, 0, 0, 1 };
+        0, 0, 0, 0, 1, 0, { { 0 } } };
+
+#define SM_DEFINE_QUEUE(_smName_, _instance_, _queueSize_) \
+    SM_DEFINE_LOCKED(_smName_, _instance_, _queueSize_, SM_LOCK_NONE)
+
+#define SM_DEFINE_LOCKED(_smName_, _instance_, _queueSize_, _lockPolicy_) \
+    SM_EventEntry _smName_##Queue[_queueSize_]; \
+    SM_StateMachine _smName_##Obj = { #_smName_, _instance_, \
+        0, 0, 0, 0, 0, 0, { { 0 } }, _smName_##Queue, _queueSize_, 0, 0, 0, \
+        _lockPolicy_ };
+
+// Defines an instance of the table mode state machine _machine_
+#define SM_DEFINE_TABLE(_smName_, _instance_, _machine_, _queueSize_, _lockPolicy_) \
+    SM_EventEntry _smName_##Queue[_queueSize_]; \
+    SM_StateMachine _smName_##Obj = { #_smName_, _instance_, \
+        0, 0, 0, 0, 0, 0, { { 0 } }, _smName_##Queue, _queueSize_, 0, 0, 0, \
+        _lockPolicy_, NULL, NULL, 0, 0, &_machine_##Const };
+
+// Defines an instance with orthogonal regions. The remaining arguments list
+// the regions with SM_REGION. Every region machine must have the same
+// events, and the instance accepts table mode events only.
+#define SM_DEFINE_REGIONS(_smName_, _instance_, _queueSize_, _lockPolicy_, ...) \
+    SM_EventEntry _smName_##Queue[_queueSize_]; \
+    SM_Region _smName_##Regions[] = { __VA_ARGS__ }; \
+    SM_StateMachine _smName_##Obj = { #_smName_, _instance_, \
+        0, 0, 0, 0, 0, 0, { { 0 } }, _smName_##Queue, _queueSize_, 0, 0, 0, \
+        _lockPolicy_, NULL, NULL, 0, 0, NULL, 0, 0, 0, \
+        _smName_##Regions, (sizeof(_smName_##Regions)/sizeof(_smName_##Regions[0])) };
+
+// A region running the table mode state machine _machine_. Its state
+// functions get _instance_ from SM_GetInstance, or the instance data of the
+// state machine if _instance_ is NULL.
+#define SM_REGION(_machine_, _instance_) \
+    { &_machine_##Const, _instance_, 0, 0, { 0 } }
 
 #define EVENT_DECLARE(_eventFunc_, _eventData_) \
     void _eventFunc_(SM_StateMachine* self, _eventData_* pEventData);
@@ -123,6 +719,12 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
 #define GUARD_DEFINE(_guardFunc_, _eventData_) \
     static BOOL GD_##_guardFunc_(SM_StateMachine* self, _eventData_* pEventData)
 
+#define ACTION_DECLARE(_actionFunc_, _eventData_) \
+    static void AC_##_actionFunc_(SM_StateMachine* self, _eventData_* pEventData);
+
+#define ACTION_DEFINE(_actionFunc_, _eventData_) \
+    static void AC_##_actionFunc_(SM_StateMachine* self, _eventData_* pEventData)
+
 #define ENTRY_DECLARE(_entryFunc_, _eventData_) \
     static void EN_##_entryFunc_(SM_StateMachine* self, _eventData_* pEventData);
 
@@ -143,9 +745,29 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
 
 #define END_STATE_MAP(_smName_) \
     }; \
+    _SM_WCET_DEFINE(_smName_) \
     static const SM_StateMachineConst _smName_##Const = { #_smName_, \
         (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
-        _smName_##StateMap, NULL };
+        _smName_##StateMap, NULL, 0, NULL, \
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, SM_HOOKS, \
+        NULL, NULL, NULL, 0, _SM_WCET(_smName_) };
+
+// Ends the state map of a table mode state machine. The transition table
+// must precede the state map.
+#define END_STATE_MAP_TABLE(_smName_) \
+    }; \
+    _SM_COVERAGE_DEFINE(_smName_, sizeof(_smName_##Transitions[0])/sizeof(BYTE)) \
+    _SM_WCET_DEFINE(_smName_) \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, \
+        (sizeof(_smName_##Transitions[0])/sizeof(BYTE)), \
+        &_smName_##Transitions[0][0], \
+        NULL, NULL, NULL, NULL, NULL, NULL, _SM_COVERAGE(_smName_), SM_HOOKS, \
+        NULL, NULL, NULL, 0, _SM_WCET(_smName_) }; \
+    C_ASSERT_GLOBAL(_smName_##TransitionRows, \
+        (sizeof(_smName_##Transitions)/sizeof(_smName_##Transitions[0])) == \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])));
 
 #define BEGIN_STATE_MAP_EX(_smName_) \
     static const SM_StateStructEx _smName_##StateMap[] = { 
@@ -158,9 +780,27 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
 
 #define END_STATE_MAP_EX(_smName_) \
     }; \
+    _SM_WCET_DEFINE(_smName_) \
     static const SM_StateMachineConst _smName_##Const = { #_smName_, \
         (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
-        NULL, _smName_##StateMap };
+        NULL, _smName_##StateMap, 0, NULL, \
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, SM_HOOKS, \
+        NULL, NULL, NULL, 0, _SM_WCET(_smName_) };
+
+#define END_STATE_MAP_TABLE_EX(_smName_) \
+    }; \
+    _SM_COVERAGE_DEFINE(_smName_, sizeof(_smName_##Transitions[0])/sizeof(BYTE)) \
+    _SM_WCET_DEFINE(_smName_) \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        NULL, _smName_##StateMap, \
+        (sizeof(_smName_##Transitions[0])/sizeof(BYTE)), \
+        &_smName_##Transitions[0][0], \
+        NULL, NULL, NULL, NULL, NULL, NULL, _SM_COVERAGE(_smName_), SM_HOOKS, \
+        NULL, NULL, NULL, 0, _SM_WCET(_smName_) }; \
+    C_ASSERT_GLOBAL(_smName_##TransitionRows, \
+        (sizeof(_smName_##Transitions)/sizeof(_smName_##Transitions[0])) == \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])));
 
 #define BEGIN_TRANSITION_MAP \
     static const BYTE TRANSITIONS[] = { \
@@ -170,9 +810,342 @@ void _SM_StateEngineEx(SM_StateMachine* self, const SM_StateMachineConst* selfCo
 
 #define END_TRANSITION_MAP(_smName_, _eventData_) \
     }; \
-    _SM_ExternalEvent(self, &_smName_##Const, TRANSITIONS[self->currentState], _eventData_); \
+    _SM_ExternalEvent(self, &_smName_##Const, _SM_STATE_ID(TRANSITIONS[self->currentState]), _eventData_); \
     C_ASSERT((sizeof(TRANSITIONS)/sizeof(BYTE)) == (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])));
 
+// Dense transition table for table mode. One row per state in state map
+// order, one column per event in event ID order.
+#define BEGIN_TRANSITION_TABLE(_smName_, _maxEvents_) \
+    static const BYTE _smName_##Transitions[][_maxEvents_] = {
+
+// 16 bit transition table of a machine with more than 251 states, see
+// SM_MACHINE_TABLE16
+#define BEGIN_TRANSITION_TABLE16(_smName_, _maxEvents_) \
+    static const UINT16 _smName_##Transitions[][_maxEvents_] = {
+
+#define TRANSITION_TABLE_ROW(...) \
+    { __VA_ARGS__ },
+
+#define END_TRANSITION_TABLE(_smName_) \
+    };
+
+// Single source state machine definition. A machine lists its events and
+// states once, each list a macro taking the name of an entry macro X, see
+// app/fsm_led_def.h. An event entry is X(event, event data type). A state
+// entry is X(state, state function, event data type, (row)) where row has
+// one transition table cell per event in event list order. The lists are
+// expanded with the SM_X_* entry macros below and SM_MACHINE_TABLE.
+#define SM_X_EVENT_ENUM(_event_, _eventData_) \
+    _event_,
+
+#define SM_X_EVENT_NAME(_event_, _eventData_) \
+    #_event_,
+
+#define SM_X_STATE_ENUM(_state_, _stateFunc_, _eventData_, _row_) \
+    _state_,
+
+#define SM_X_STATE_DECLARE(_state_, _stateFunc_, _eventData_, _row_) \
+    STATE_DECLARE(_stateFunc_, _eventData_)
+
+#define SM_X_STATE_MAP_ENTRY(_state_, _stateFunc_, _eventData_, _row_) \
+    STATE_MAP_ENTRY(_stateFunc_)
+
+#define SM_X_STATE_NAME(_state_, _stateFunc_, _eventData_, _row_) \
+    #_state_,
+
+#define SM_X_ROW(_state_, _stateFunc_, _eventData_, _row_) \
+    TRANSITION_TABLE_ROW _row_
+
+#define SM_X_CELLS(...) \
+    __VA_ARGS__
+
+// Switch statement case of a generated state engine, see SM_MACHINE_TABLE
+#define SM_X_STATE_CASE(_state_, _stateFunc_, _eventData_, _row_) \
+    case _state_: \
+        ST_##_stateFunc_(self, (_eventData_*)pEventData); \
+        break;
+
+// A short row would silently be padded with transitions to state 0, so each
+// row must have exactly one cell per event
+#define SM_X_ROW_CHECK(_state_, _stateFunc_, _eventData_, _row_) \
+    C_ASSERT(sizeof((const int[]){ SM_X_CELLS _row_ }) / sizeof(int) == SM_X_COLUMNS);
+
+// Hierarchy list entry X(state, parent superstate)
+#define SM_X_PARENT(_state_, _parent_) \
+    [_state_] = (_parent_) + 1,
+
+#define SM_X_PARENT_CHECK(_state_, _parent_) \
+    C_ASSERT((int)(_parent_) < SM_X_STATES && (_parent_) != (_state_));
+
+// History list entry X(superstate, SM_HISTORY_SHALLOW or SM_HISTORY_DEEP,
+// history slot). Each superstate with history has its own slot.
+#define SM_X_HISTORY(_state_, _kind_, _slot_) \
+    [_state_] = (_kind_) | (_slot_),
+
+#define SM_X_HISTORY_CHECK(_state_, _kind_, _slot_) \
+    C_ASSERT((_slot_) < SM_HSM_HISTORY_SLOTS);
+
+// Guarded transition list entry X(state, event, guard, action, new state).
+// The guard and action are the GD_ and AC_ names from GUARD_DEFINE and
+// ACTION_DEFINE, or NULL. The cell of the state and event is SM_GUARDED.
+#define SM_X_GUARDED(_state_, _event_, _guard_, _action_, _newState_) \
+    { _state_, _event_, (SM_GuardFunc)_guard_, (SM_ActionFunc)_action_, _newState_ },
+
+#define SM_X_GUARDED_CHECK(_state_, _event_, _guard_, _action_, _newState_) \
+    C_ASSERT((int)(_state_) < SM_X_STATES && (int)(_event_) < SM_X_COLUMNS && \
+        (int)(_newState_) < SM_X_STATES);
+
+// Action list entry X(state, entry function, exit function). The functions
+// are the EN_ and EX_ names from ENTRY_DEFINE and EXIT_DEFINE, or NULL.
+#define SM_X_ACTIONS(_state_, _entryFunc_, _exitFunc_) \
+    [_state_] = { (SM_EntryFunc)_entryFunc_, (SM_ExitFunc)_exitFunc_ },
+
+// Defines the transition table, state map, name strings and constant data of
+// a table mode state machine from its event and state lists. The state
+// enumeration and state function declarations must precede it. The row
+// checks live in a function that is never called and costs nothing at run
+// time.
+#define SM_MACHINE_TABLE(_smName_, _states_, _events_, _maxEvents_) \
+    _SM_MACHINE_TABLES(_smName_, _states_, _events_, _maxEvents_) \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, _maxEvents_, \
+        &_smName_##Transitions[0][0], \
+        _smName_##StateNames, _smName_##EventNames, NULL, NULL, NULL, \
+        _SM_ENGINE(_smName_), _SM_COVERAGE(_smName_), SM_HOOKS, NULL, NULL, \
+        NULL, 0, _SM_WCET(_smName_) }; \
+    _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static inline void _smName_##Check(void) \
+    { \
+        _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+        C_ASSERT((int)SM_X_STATES <= (int)SM_GUARDED); \
+    }
+
+// Defines a table mode state machine like SM_MACHINE_TABLE, with the guarded
+// transitions of its SM_GUARDED cells listed in _guarded_
+#define SM_MACHINE_GUARDED(_smName_, _states_, _events_, _guarded_, _maxEvents_) \
+    _SM_MACHINE_TABLES(_smName_, _states_, _events_, _maxEvents_) \
+    _SM_GUARDED_DEFINE(_smName_, _guarded_) \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, _maxEvents_, \
+        &_smName_##Transitions[0][0], \
+        _smName_##StateNames, _smName_##EventNames, NULL, NULL, NULL, \
+        _SM_ENGINE(_smName_), _SM_COVERAGE(_smName_), SM_HOOKS, NULL, NULL, \
+        _SM_GUARDED(_smName_), _SM_WCET(_smName_) }; \
+    _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static inline void _smName_##Check(void) \
+    { \
+        _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+        C_ASSERT((int)SM_X_STATES <= (int)SM_GUARDED); \
+        _guarded_(SM_X_GUARDED_CHECK) \
+    }
+
+// Defines a table mode state machine like SM_MACHINE_TABLE with a 16 bit
+// transition table, for machines with more than 251 states. Cells use the
+// _16 sentinels. The table takes twice the flash, so small machines should
+// keep SM_MACHINE_TABLE. Machines with a 16 bit table can't be hierarchical.
+#define SM_MACHINE_TABLE16(_smName_, _states_, _events_, _maxEvents_) \
+    BEGIN_TRANSITION_TABLE16(_smName_, _maxEvents_) \
+        _states_(SM_X_ROW) \
+    END_TRANSITION_TABLE(_smName_) \
+    _SM_MACHINE_MAPS(_smName_, _states_, _events_, _maxEvents_) \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, _maxEvents_, NULL, \
+        _smName_##StateNames, _smName_##EventNames, NULL, NULL, NULL, \
+        _SM_ENGINE(_smName_), _SM_COVERAGE(_smName_), SM_HOOKS, \
+        &_smName_##Transitions[0][0], NULL, NULL, 0, _SM_WCET(_smName_) }; \
+    _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static inline void _smName_##Check(void) \
+    { \
+        _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+        C_ASSERT((int)SM_X_STATES <= (int)SM_GUARDED_16); \
+    }
+
+// Row displaced table list entry X(state, row offset, row default) and cell
+// list entry X(owner state, event, cell), see SM_MACHINE_SPARSE
+#define SM_X_SPARSE_BASE(_state_, _base_, _default_) \
+    [_state_] = (_base_),
+
+#define SM_X_SPARSE_DEFAULT(_state_, _base_, _default_) \
+    [_state_] = (_default_),
+
+#define SM_X_SPARSE_ROW_COUNT(_state_, _base_, _default_) \
+    0,
+
+#define SM_X_SPARSE_ROW_CHECK(_state_, _base_, _default_) \
+    C_ASSERT((int)(_base_) + SM_X_COLUMNS <= SM_X_SPARSE_CELLS); \
+    C_ASSERT((int)(_default_) < SM_X_STATES || (int)(_default_) >= SM_GUARDED);
+
+#define SM_X_SPARSE_CHECK(_state_, _event_, _cell_) \
+    (_event_),
+
+#define SM_X_SPARSE_NEXT(_state_, _event_, _cell_) \
+    (_cell_),
+
+// Defines a table mode state machine like SM_MACHINE_TABLE from a row
+// displaced transition table instead of a dense one. _rows_ lists the row
+// offset and row default of every state, _cells_ the cells of all rows
+// overlaid, as emitted by tools/sm_gen.py --sparse, which also checks that
+// they match the rows of the state list. The rows must have distinct
+// offsets and every row must fit in the cells. Cells are one byte, so a
+// machine with a row displaced table has at most 251 states, and can't be
+// hierarchical.
+#define SM_MACHINE_SPARSE(_smName_, _states_, _events_, _rows_, _cells_, _maxEvents_) \
+    _SM_MACHINE_MAPS(_smName_, _states_, _events_, _maxEvents_) \
+    static const UINT16 _smName_##SparseBase[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])] = { \
+        _rows_(SM_X_SPARSE_BASE) }; \
+    static const BYTE _smName_##SparseDefaults[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])] = { \
+        _rows_(SM_X_SPARSE_DEFAULT) }; \
+    static const BYTE _smName_##SparseCheck[] = { _cells_(SM_X_SPARSE_CHECK) }; \
+    static const BYTE _smName_##SparseNext[] = { _cells_(SM_X_SPARSE_NEXT) }; \
+    static const SM_SparseTable _smName_##Sparse = { _smName_##SparseBase, _smName_##SparseDefaults, \
+        _smName_##SparseCheck, _smName_##SparseNext, sizeof(_smName_##SparseCheck) }; \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, _maxEvents_, NULL, \
+        _smName_##StateNames, _smName_##EventNames, NULL, NULL, NULL, \
+        _SM_ENGINE(_smName_), _SM_COVERAGE(_smName_), SM_HOOKS, NULL, &_smName_##Sparse, \
+        NULL, 0, _SM_WCET(_smName_) }; \
+    _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static inline void _smName_##Check(void) \
+    { \
+        _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+        C_ASSERT((int)SM_X_STATES <= (int)SM_GUARDED); \
+        C_ASSERT(sizeof((const BYTE[]){ _rows_(SM_X_SPARSE_ROW_COUNT) }) == SM_X_STATES); \
+        enum { SM_X_SPARSE_CELLS = sizeof(_smName_##SparseCheck) }; \
+        C_ASSERT(SM_X_SPARSE_CELLS <= 0xFFFF); \
+        _rows_(SM_X_SPARSE_ROW_CHECK) \
+    }
+
+// Defines a hierarchical state machine like SM_MACHINE_TABLE, with the
+// superstate of each state listed in _parents_, the entry and exit actions
+// of each state listed in _actions_, the superstates with history listed
+// in _history_ and the guarded transitions listed in _guarded_. States not
+// listed are top level states without actions or history.
+#define SM_MACHINE_HSM(_smName_, _states_, _events_, _parents_, _actions_, _history_, _guarded_, _maxEvents_) \
+    _SM_MACHINE_TABLES(_smName_, _states_, _events_, _maxEvents_) \
+    _SM_GUARDED_DEFINE(_smName_, _guarded_) \
+    static const BYTE _smName_##Parents[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])] = { \
+        _parents_(SM_X_PARENT) }; \
+    static const SM_HsmActions _smName_##Actions[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])] = { \
+        _actions_(SM_X_ACTIONS) }; \
+    static const BYTE _smName_##History[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])] = { \
+        _history_(SM_X_HISTORY) }; \
+    const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        (sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])), \
+        _smName_##StateMap, NULL, _maxEvents_, \
+        &_smName_##Transitions[0][0], \
+        _smName_##StateNames, _smName_##EventNames, \
+        _smName_##Parents, _smName_##Actions, _smName_##History, \
+        _SM_ENGINE(_smName_), _SM_COVERAGE(_smName_), SM_HOOKS, NULL, NULL, \
+        _SM_GUARDED(_smName_), _SM_WCET(_smName_) }; \
+    _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static inline void _smName_##Check(void) \
+    { \
+        _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+        C_ASSERT((int)SM_X_STATES <= (int)SM_GUARDED); \
+        _parents_(SM_X_PARENT_CHECK) \
+        _history_(SM_X_HISTORY_CHECK) \
+        _guarded_(SM_X_GUARDED_CHECK) \
+    }
+
+#define _SM_MACHINE_TABLES(_smName_, _states_, _events_, _maxEvents_) \
+    BEGIN_TRANSITION_TABLE(_smName_, _maxEvents_) \
+        _states_(SM_X_ROW) \
+    END_TRANSITION_TABLE(_smName_) \
+    _SM_MACHINE_MAPS(_smName_, _states_, _events_, _maxEvents_)
+
+// The guarded transitions of a machine, ending with an unused entry so the
+// list may be empty
+#define _SM_GUARDED_DEFINE(_smName_, _guarded_) \
+    static const SM_GuardedTransition _smName_##Guarded[] = { \
+        _guarded_(SM_X_GUARDED) { 0, 0, NULL, NULL, 0 } };
+
+#define _SM_GUARDED(_smName_) \
+    _smName_##Guarded, (sizeof(_smName_##Guarded)/sizeof(_smName_##Guarded[0])) - 1
+
+#define _SM_MACHINE_MAPS(_smName_, _states_, _events_, _maxEvents_) \
+    static const CHAR* const _smName_##StateNames[] = { _states_(SM_X_STATE_NAME) }; \
+    static const CHAR* const _smName_##EventNames[] = { _events_(SM_X_EVENT_NAME) }; \
+    BEGIN_STATE_MAP(_smName_) \
+        _states_(SM_X_STATE_MAP_ENTRY) \
+    }; \
+    _SM_ENGINE_DECLARE(_smName_) \
+    _SM_COVERAGE_DEFINE(_smName_, _maxEvents_) \
+    _SM_WCET_DEFINE(_smName_)
+
+#ifdef USE_SM_SWITCH_ENGINE
+#define _SM_ENGINE(_smName_) \
+    _smName_##Engine
+
+#define _SM_ENGINE_DECLARE(_smName_) \
+    static void _smName_##Engine(struct SM_StateMachine* self);
+
+// The state engine of one machine, see _SM_StateEngine
+#define _SM_ENGINE_DEFINE(_smName_, _states_) \
+    static void _smName_##Engine(struct SM_StateMachine* self) \
+    { \
+        while (self->eventGenerated) \
+        { \
+            void* pEventData = _SM_StateEnterInline(self, &_smName_##Const); \
+            _SM_PROFILE_BEGIN(); \
+            _SM_WCET_BEGIN(); \
+            switch (self->currentState) \
+            { \
+            _states_(SM_X_STATE_CASE) \
+            default: \
+                ASSERT_TRUE(FALSE); \
+                break; \
+            } \
+            _SM_WCET_STATE_END(self, &_smName_##Const); \
+            _SM_PROFILE_END(self); \
+            if (pEventData) \
+                _SM_FreeEventData(self, pEventData); \
+        } \
+    }
+#else
+#define _SM_ENGINE(_smName_) \
+    NULL
+#define _SM_ENGINE_DECLARE(_smName_)
+#define _SM_ENGINE_DEFINE(_smName_, _states_)
+#endif
+
+// Transition table cell hit counters of one machine, shared by all of its
+// instances
+#ifdef USE_SM_COVERAGE
+#define _SM_COVERAGE(_smName_) \
+    &_smName_##Coverage[0][0]
+
+#define _SM_COVERAGE_DEFINE(_smName_, _maxEvents_) \
+    static UINT32 _smName_##Coverage[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])][_maxEvents_];
+#else
+#define _SM_COVERAGE(_smName_) \
+    NULL
+#define _SM_COVERAGE_DEFINE(_smName_, _maxEvents_)
+#endif
+
+// Function timings of one machine, shared by all of its instances
+#ifdef USE_SM_WCET
+#define _SM_WCET(_smName_) \
+    &_smName_##Wcet
+
+#define _SM_WCET_DEFINE(_smName_) \
+    static SM_WcetStats _smName_##WcetFunctions[sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0])][SM_WCET_KINDS]; \
+    static SM_WcetTable _smName_##Wcet = { &_smName_##WcetFunctions[0][0] };
+#else
+#define _SM_WCET(_smName_) \
+    NULL
+#define _SM_WCET_DEFINE(_smName_)
+#endif
+
+#define _SM_MACHINE_CHECKS(_smName_, _states_, _maxEvents_) \
+    enum { SM_X_COLUMNS = _maxEvents_, \
+        SM_X_STATES = sizeof(_smName_##StateMap)/sizeof(_smName_##StateMap[0]) }; \
+    _states_(SM_X_ROW_CHECK) \
+    C_ASSERT((sizeof(_smName_##EventNames)/sizeof(_smName_##EventNames[0])) == SM_X_COLUMNS);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,145 @@
+#include "Fault.h"
+#include "sm_allocator.h"
+#include "sm_port.h"
+
+// A free block holds the link to the next free block of its pool
+typedef union SMALLOC_Block
+{
+    union SMALLOC_Block* pNext;
+} SMALLOC_Block;
+
+// Size class bookkeeping
+typedef struct
+{
+    BYTE* const pool;           // First byte of the pool storage
+    const UINT16 blockSize;     // Size of each block in bytes
+    const UINT16 blockCount;    // Number of blocks in the pool
+    UINT16 unused;              // Index of the first block never handed out
+    SMALLOC_Block* pFree;       // Blocks that have been released
+    SMALLOC_Stats stats;
+} SMALLOC_Pool;
+
+// Pool storage is word aligned so any event data structure fits a block
+#define SMALLOC_STORAGE(_size_) \
+    static UINT32 smallocStorage##_size_[(_size_) * SMALLOC_BLOCKS_##_size_ / sizeof(UINT32)];
+
+#define SMALLOC_POOL(_size_) \
+    { (BYTE*)smallocStorage##_size_, _size_, SMALLOC_BLOCKS_##_size_, 0, NULL, \
+        { _size_, SMALLOC_BLOCKS_##_size_, 0, 0, 0, 0 } },
+
+SMALLOC_STORAGE(16)
+SMALLOC_STORAGE(32)
+SMALLOC_STORAGE(64)
+
+// Size classes, smallest first
+static SMALLOC_Pool smallocPools[] = {
+    SMALLOC_POOL(16)
+    SMALLOC_POOL(32)
+    SMALLOC_POOL(64)
+};
+
+#define SMALLOC_CLASSES     (sizeof(smallocPools)/sizeof(smallocPools[0]))
+
+static UINT32 smallocFailed;
+
+void* SMALLOC_Alloc(size_t size)
+{
+    SMALLOC_Block* pBlock = NULL;
+    UINT i;
+
+    SM_CRITICAL_ENTER();
+
+    for (i = 0; i < SMALLOC_CLASSES; i++)
+    {
+        SMALLOC_Pool* pPool = &smallocPools[i];
+
+        if (size > pPool->blockSize)
+            continue;
+
+        // Reuse a released block first, then carve a new one. Carving
+        // lazily means the pools need no initialization call.
+        if (pPool->pFree)
+        {
+            pBlock = pPool->pFree;
+            pPool->pFree = pBlock->pNext;
+        }
+        else if (pPool->unused < pPool->blockCount)
+        {
+            pBlock = (SMALLOC_Block*)(pPool->pool + (pPool->unused * pPool->blockSize));
+            pPool->unused++;
+        }
+        else
+        {
+            // Exhausted, fall through to the next larger class
+            pPool->stats.failed++;
+            continue;
+        }
+
+        pPool->stats.allocs++;
+        if (++pPool->stats.inUse > pPool->stats.peak)
+            pPool->stats.peak = pPool->stats.inUse;
+        break;
+    }
+
+    if (pBlock == NULL)
+        smallocFailed++;
+
+    SM_CRITICAL_EXIT();
+
+    return pBlock;
+}
+
+void SMALLOC_Free(void* ptr)
+{
+    BYTE* pByte = (BYTE*)ptr;
+    UINT i;
+
+    if (ptr == NULL)
+        return;
+
+    for (i = 0; i < SMALLOC_CLASSES; i++)
+    {
+        SMALLOC_Pool* pPool = &smallocPools[i];
+
+        if (pByte >= pPool->pool && pByte < pPool->pool + (pPool->blockCount * pPool->blockSize))
+        {
+            // Must be the start of a block handed out by this pool
+            ASSERT_TRUE(((pByte - pPool->pool) % pPool->blockSize) == 0);
+
+            SM_CRITICAL_ENTER();
+            ASSERT_TRUE(pPool->stats.inUse > 0);
+            ((SMALLOC_Block*)ptr)->pNext = pPool->pFree;
+            pPool->pFree = (SMALLOC_Block*)ptr;
+            pPool->stats.inUse--;
+            SM_CRITICAL_EXIT();
+            return;
+        }
+    }
+
+    // Not a block from any pool
+    ASSERT_TRUE(FALSE);
+}
+
+UINT SMALLOC_GetClassCount(void)
+{
+    return SMALLOC_CLASSES;
+}
+
+BOOL SMALLOC_GetStats(UINT sizeClass, SMALLOC_Stats* pStats)
+{
+    ASSERT_TRUE(pStats);
+
+    if (sizeClass >= SMALLOC_CLASSES)
+        return FALSE;
+
+    SM_CRITICAL_ENTER();
+    *pStats = smallocPools[sizeClass].stats;
+    SM_CRITICAL_EXIT();
+
+    return TRUE;
+}
+
+UINT32 SMALLOC_GetFailed(void)
+{
+    return smallocFailed;
+}
@@ -0,0 +1,71 @@
+// Fixed block allocator for state machine event data.
+//
+// Event data is served from a small number of statically allocated pools,
+// one per block size. A request is satisfied from the smallest size class
+// that fits, or the next larger class if that one is exhausted. Allocation
+// and release take constant time, never fragment and may be called from
+// interrupt context.
+//
+// Override the SMALLOC_BLOCKS_xx defines to size the pools for the
+// application.
+
+#ifndef _SM_ALLOCATOR_H
+#define _SM_ALLOCATOR_H
+
+#include <stddef.h>
+#include "DataTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of blocks in each size class
+#ifndef SMALLOC_BLOCKS_16
+#define SMALLOC_BLOCKS_16       16
+#endif
+
+#ifndef SMALLOC_BLOCKS_32
+#define SMALLOC_BLOCKS_32       8
+#endif
+
+#ifndef SMALLOC_BLOCKS_64
+#define SMALLOC_BLOCKS_64       4
+#endif
+
+// Usage counters for one size class
+typedef struct
+{
+    UINT16 blockSize;           // Size of each block in bytes
+    UINT16 blockCount;          // Number of blocks in the pool
+    UINT16 inUse;               // Blocks currently allocated
+    UINT16 peak;                // Most blocks ever allocated at once
+    UINT32 allocs;              // Requests served by this class
+    UINT32 failed;              // Requests that found this class exhausted
+} SMALLOC_Stats;
+
+/// Allocate a block of at least size bytes.
+/// @param[in] size - number of bytes required
+/// @return Pointer to the block, or NULL if no size class can satisfy the request
+void* SMALLOC_Alloc(size_t size);
+
+/// Return a block obtained from SMALLOC_Alloc. NULL is ignored.
+/// @param[in] ptr - block to release
+void SMALLOC_Free(void* ptr);
+
+/// @return The number of size classes
+UINT SMALLOC_GetClassCount(void);
+
+/// Read the counters of one size class.
+/// @param[in] sizeClass - index of the size class, smallest first
+/// @param[out] pStats - receives a copy of the counters
+/// @return TRUE if sizeClass is valid
+BOOL SMALLOC_GetStats(UINT sizeClass, SMALLOC_Stats* pStats);
+
+/// @return The number of requests that could not be satisfied by any class
+UINT32 SMALLOC_GetFailed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_ALLOCATOR_H
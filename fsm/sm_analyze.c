@@ -0,0 +1,369 @@
+#include <string.h>
+
+#include "Fault.h"
+#include "sm_analyze.h"
+
+#define SM_ANALYZE_SET_WORDS    ((SM_ANALYZE_MAX_STATES + 31) / 32)
+
+#define SET_ADD(_set_, _bit_)   ((_set_)[(_bit_) >> 5] |= 1UL << ((_bit_) & 31))
+#define SET_HAS(_set_, _bit_)   (((_set_)[(_bit_) >> 5] >> ((_bit_) & 31)) & 1)
+
+// Work space. Automatic transitions are kept as an adjacency bit matrix,
+// which bounds the memory whatever the length of the transition list.
+static UINT32 internalEdges[SM_ANALYZE_MAX_STATES][SM_ANALYZE_SET_WORDS];
+static UINT32 reachable[SM_ANALYZE_SET_WORDS];
+static UINT32 superstates[SM_ANALYZE_SET_WORDS];
+static SM_StateId queue[SM_ANALYZE_MAX_STATES];
+
+// Tarjan's strongly connected components, iterative
+static UINT16 sccIndex[SM_ANALYZE_MAX_STATES];
+static UINT16 sccLow[SM_ANALYZE_MAX_STATES];
+static UINT16 sccNext[SM_ANALYZE_MAX_STATES];
+static BYTE sccOnStack[SM_ANALYZE_MAX_STATES];
+static SM_StateId sccStack[SM_ANALYZE_MAX_STATES];
+static SM_StateId sccCall[SM_ANALYZE_MAX_STATES];
+
+static UINT _SM_Report(const SM_AnalyzeMachine* machine, SM_IssueFunc report, void* context,
+    SM_IssueType type, SM_StateId state, BYTE event)
+{
+    SM_Issue issue = { type, state, event, NULL, 0 };
+
+    if (report)
+        report(context, machine, &issue);
+    return 1;
+}
+
+static BOOL _SM_IsState(const SM_StateMachineConst* c, SM_StateId cell)
+{
+    return cell < c->maxStates;
+}
+
+static BOOL _SM_IsSentinel(SM_StateId cell)
+{
+    return cell == EVENT_IGNORED_16 || cell == CANNOT_HAPPEN_16 || cell == SM_INHERIT_16 || cell == SM_DEFER_16 ||
+        cell == SM_GUARDED_16;
+}
+
+// Returns the superstate of a state, or maxStates for a top level state
+static UINT _SM_Parent(const SM_StateMachineConst* c, UINT state)
+{
+    if (!c->parents || !c->parents[state] || c->parents[state] > c->maxStates)
+        return c->maxStates;
+    return c->parents[state] - 1U;
+}
+
+// Returns the cell of a state and event, whatever the form of the table,
+// with SM_INHERIT resolved through the superstates as the engine does, a top
+// level SM_INHERIT is ignored. Sentinels are the _16 ones. The state whose
+// cell it is is returned in pOwner if not NULL.
+static SM_StateId _SM_Cell(const SM_StateMachineConst* c, UINT state, UINT event, UINT* pOwner)
+{
+    UINT depth;
+
+    for (depth = 0; depth < SM_HSM_MAX_DEPTH; depth++)
+    {
+        SM_StateId cell = _SM_TableCell(c, (SM_StateId)state, (BYTE)event);
+
+        if (pOwner)
+            *pOwner = state;
+        if (cell != SM_INHERIT_16)
+            return cell;
+        state = _SM_Parent(c, state);
+        if (state >= c->maxStates)
+            break;
+    }
+    return EVENT_IGNORED_16;
+}
+
+// Returns TRUE if guarded transition i is one of a state and event
+static BOOL _SM_IsGuarded(const SM_StateMachineConst* c, UINT i, UINT state, UINT event)
+{
+    return i < c->guardedCount && c->guarded[i].state == state && c->guarded[i].eventId == event;
+}
+
+// Returns the index of the first guarded transition of a state and event,
+// or guardedCount if it has none
+static UINT _SM_FirstGuarded(const SM_StateMachineConst* c, UINT state, UINT event)
+{
+    UINT i;
+
+    for (i = 0; i < c->guardedCount && !_SM_IsGuarded(c, i, state, event); i++)
+        ;
+    return i;
+}
+
+// Reports every cycle of automatic transitions. Returns the number found.
+static UINT _SM_FindCycles(const SM_AnalyzeMachine* machine, SM_IssueFunc report, void* context)
+{
+    const UINT states = machine->machine->maxStates;
+    UINT16 index = 1;
+    UINT stackTop = 0;
+    UINT issues = 0;
+    UINT root;
+
+    memset(sccIndex, 0, sizeof(sccIndex));
+    memset(sccOnStack, 0, sizeof(sccOnStack));
+
+    for (root = 0; root < states; root++)
+    {
+        UINT callTop = 0;
+
+        if (sccIndex[root])
+            continue;
+
+        sccCall[callTop++] = (SM_StateId)root;
+        sccIndex[root] = sccLow[root] = index++;
+        sccNext[root] = 0;
+        sccStack[stackTop++] = (SM_StateId)root;
+        sccOnStack[root] = TRUE;
+
+        while (callTop)
+        {
+            SM_StateId v = sccCall[callTop - 1];
+
+            // Visit the next successor of v
+            while (sccNext[v] < states && !SET_HAS(internalEdges[v], sccNext[v]))
+                sccNext[v]++;
+
+            if (sccNext[v] < states)
+            {
+                SM_StateId w = sccNext[v]++;
+
+                if (!sccIndex[w])
+                {
+                    sccIndex[w] = sccLow[w] = index++;
+                    sccNext[w] = 0;
+                    sccStack[stackTop++] = w;
+                    sccOnStack[w] = TRUE;
+                    sccCall[callTop++] = w;
+                }
+                else if (sccOnStack[w] && sccIndex[w] < sccLow[v])
+                {
+                    sccLow[v] = sccIndex[w];
+                }
+                continue;
+            }
+
+            // All successors visited, return to the caller
+            callTop--;
+            if (callTop && sccLow[v] < sccLow[sccCall[callTop - 1]])
+                sccLow[sccCall[callTop - 1]] = sccLow[v];
+
+            if (sccLow[v] == sccIndex[v])
+            {
+                // v is the root of a component, pop it
+                UINT first = stackTop;
+                SM_StateId w;
+
+                do
+                {
+                    w = sccStack[--first];
+                    sccOnStack[w] = FALSE;
+                } while (w != v);
+
+                // A component is a cycle if it has more than one state or
+                // its state transitions to itself
+                if (stackTop - first > 1 || SET_HAS(internalEdges[v], v))
+                {
+                    SM_Issue issue = { SM_ISSUE_INTERNAL_CYCLE, v, 0,
+                        &sccStack[first], stackTop - first };
+
+                    if (report)
+                        report(context, machine, &issue);
+                    issues++;
+                }
+                stackTop = first;
+            }
+        }
+    }
+
+    return issues;
+}
+
+UINT SM_Analyze(const SM_AnalyzeMachine* machine, SM_IssueFunc report, void* context)
+{
+    const SM_StateMachineConst* c;
+    UINT issues = 0;
+    UINT head = 0, tail = 0;
+    UINT state, event, i;
+
+    ASSERT_TRUE(machine);
+    c = machine->machine;
+    ASSERT_TRUE(c && (c->transitions || c->transitions16 || c->sparse));
+    ASSERT_TRUE(c->maxStates <= SM_ANALYZE_MAX_STATES);
+
+    memset(internalEdges, 0, sizeof(internalEdges));
+    memset(reachable, 0, sizeof(reachable));
+    memset(superstates, 0, sizeof(superstates));
+
+    // Table cells and automatic transitions must name a state, superstates
+    // must be states
+    for (state = 0; state < c->maxStates; state++)
+    {
+        if (c->parents && c->parents[state])
+        {
+            if (_SM_Parent(c, state) < c->maxStates && _SM_Parent(c, state) != state)
+                SET_ADD(superstates, _SM_Parent(c, state));
+            else
+                issues += _SM_Report(machine, report, context, SM_ISSUE_BAD_TARGET, (SM_StateId)state, SM_ANALYZE_PARENT);
+        }
+        for (event = 0; event < c->maxEvents; event++)
+        {
+            SM_StateId cell = _SM_TableCell(c, (SM_StateId)state, (BYTE)event);
+
+            if ((!_SM_IsState(c, cell) && !_SM_IsSentinel(cell)) ||
+                (cell == SM_GUARDED_16 && _SM_FirstGuarded(c, state, event) == c->guardedCount))
+                issues += _SM_Report(machine, report, context, SM_ISSUE_BAD_TARGET, (SM_StateId)state, (BYTE)event);
+        }
+    }
+    // Guarded transitions must name a state and belong to an SM_GUARDED cell
+    for (i = 0; i < c->guardedCount; i++)
+    {
+        const SM_GuardedTransition* g = &c->guarded[i];
+
+        if (g->state >= c->maxStates || g->eventId >= c->maxEvents || !_SM_IsState(c, g->newState) ||
+            _SM_TableCell(c, g->state, g->eventId) != SM_GUARDED_16)
+            issues += _SM_Report(machine, report, context, SM_ISSUE_BAD_TARGET, g->state, g->eventId);
+    }
+    for (i = 0; i < machine->internalCount; i++)
+    {
+        const SM_InternalTransition* t = &machine->internal[i];
+
+        if (_SM_IsState(c, t->from) && _SM_IsState(c, t->to))
+            SET_ADD(internalEdges[t->from], t->to);
+        else
+            issues += _SM_Report(machine, report, context, SM_ISSUE_BAD_TARGET, t->from, SM_ANALYZE_INTERNAL);
+    }
+
+    // Breadth first search from the initial state over both kinds of
+    // transition
+    if (c->maxStates)
+    {
+        SET_ADD(reachable, 0);
+        queue[tail++] = 0;
+    }
+    while (head < tail)
+    {
+        SM_StateId from = queue[head++];
+        UINT up;
+
+        // The machine is in all superstates of a state it is in
+        for (up = _SM_Parent(c, from); up < c->maxStates && !SET_HAS(reachable, up); up = _SM_Parent(c, up))
+        {
+            SET_ADD(reachable, up);
+            queue[tail++] = (SM_StateId)up;
+        }
+
+        for (event = 0; event < c->maxEvents; event++)
+        {
+            UINT owner;
+            SM_StateId cell = _SM_Cell(c, from, event, &owner);
+
+            if (cell != SM_GUARDED_16)
+            {
+                if (_SM_IsState(c, cell) && !SET_HAS(reachable, cell))
+                {
+                    SET_ADD(reachable, cell);
+                    queue[tail++] = cell;
+                }
+                continue;
+            }
+            for (i = _SM_FirstGuarded(c, owner, event); _SM_IsGuarded(c, i, owner, event); i++)
+            {
+                SM_StateId to = c->guarded[i].newState;
+
+                if (_SM_IsState(c, to) && !SET_HAS(reachable, to))
+                {
+                    SET_ADD(reachable, to);
+                    queue[tail++] = to;
+                }
+            }
+        }
+        for (i = 0; i < SM_ANALYZE_SET_WORDS; i++)
+        {
+            UINT32 fresh = internalEdges[from][i] & ~reachable[i];
+
+            while (fresh)
+            {
+                SM_StateId to = (SM_StateId)(i * 32 + __builtin_ctz(fresh));
+
+                fresh &= fresh - 1;
+                SET_ADD(reachable, to);
+                queue[tail++] = to;
+            }
+        }
+    }
+
+    for (state = 0; state < c->maxStates; state++)
+    {
+        BOOL automatic = FALSE;
+        BOOL leaves = FALSE;
+
+        if (!SET_HAS(reachable, state))
+        {
+            issues += _SM_Report(machine, report, context, SM_ISSUE_UNREACHABLE, (SM_StateId)state, 0);
+            continue;
+        }
+        if (SET_HAS(superstates, state))
+            continue;
+
+        for (i = 0; i < SM_ANALYZE_SET_WORDS; i++)
+        {
+            UINT32 edges = internalEdges[state][i];
+
+            automatic |= edges != 0;
+            if (i == (state >> 5))
+                edges &= ~(1UL << (state & 31));
+            leaves |= edges != 0;
+        }
+        for (event = 0; event < c->maxEvents; event++)
+        {
+            UINT owner;
+            SM_StateId cell = _SM_Cell(c, state, event, &owner);
+
+            if (cell != SM_GUARDED_16)
+            {
+                leaves |= _SM_IsState(c, cell) && cell != state;
+                continue;
+            }
+            for (i = _SM_FirstGuarded(c, owner, event); _SM_IsGuarded(c, i, owner, event); i++)
+                leaves |= c->guarded[i].newState != state;
+        }
+
+        if (!leaves)
+            issues += _SM_Report(machine, report, context, SM_ISSUE_DEAD_END, (SM_StateId)state, 0);
+
+        // The machine rests in a state without automatic transitions, so
+        // any event can arrive there
+        if (!automatic)
+        {
+            for (event = 0; event < c->maxEvents; event++)
+            {
+                if (_SM_Cell(c, state, event, NULL) == CANNOT_HAPPEN_16)
+                    issues += _SM_Report(machine, report, context, SM_ISSUE_CANNOT_HAPPEN, (SM_StateId)state, (BYTE)event);
+            }
+        }
+    }
+
+    issues += _SM_FindCycles(machine, report, context);
+
+    return issues;
+}
+
+const CHAR* SM_AnalyzeStateName(const SM_AnalyzeMachine* machine, SM_StateId state)
+{
+    const SM_StateMachineConst* c = machine->machine;
+
+    if (!c->stateNames || state >= c->maxStates)
+        return NULL;
+    return c->stateNames[state];
+}
+
+const CHAR* SM_AnalyzeEventName(const SM_AnalyzeMachine* machine, BYTE event)
+{
+    const SM_StateMachineConst* c = machine->machine;
+
+    if (!c->eventNames || event >= c->maxEvents)
+        return NULL;
+    return c->eventNames[event];
+}
@@ -0,0 +1,154 @@
+// Static analysis of table mode state machines.
+//
+// SM_Analyze walks a machine's transition table together with the list of
+// automatic transitions its state functions make with SM_InternalEvent, and
+// reports:
+//
+//   - states that can't be reached from the initial state
+//   - reachable states that can never be left
+//   - CANNOT_HAPPEN cells of states the machine can rest in, so an event
+//     really can happen there and will fault
+//   - cycles of automatic transitions, which would keep the state engine
+//     running forever without another external event
+//   - table cells and automatic transitions that name no state
+//
+// The guarded transitions of an SM_GUARDED cell are each assumed to be
+// taken, and each must name a state.
+//
+// A state that makes automatic transitions is assumed to always make one,
+// so the machine never rests there. In a hierarchical machine SM_INHERIT
+// cells are resolved through the superstates, a superstate is reachable when
+// one of its substates is, and superstates are not checked for being left or
+// for CANNOT_HAPPEN cells as the machine only rests in their substates.
+//
+// Dense byte, 16 bit and row displaced tables are all analyzed, of machines
+// of up to SM_ANALYZE_MAX_STATES states. The analysis is linear in the size
+// of the table and needs no allocation. It is meant to run on a host as part
+// of the build, see tools/sm_check.c.
+
+#ifndef _SM_ANALYZE_H
+#define _SM_ANALYZE_H
+
+#include "DataTypes.h"
+#include "StateMachine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest machine analyzed. The work space grows with its square.
+#ifndef SM_ANALYZE_MAX_STATES
+#define SM_ANALYZE_MAX_STATES   1024
+#endif
+
+// An automatic transition made by a state function
+typedef struct
+{
+    SM_StateId from;
+    SM_StateId to;
+} SM_InternalTransition;
+
+// Analysis input, a machine's constant data and its automatic transitions
+typedef struct
+{
+    const SM_StateMachineConst* machine;
+    const SM_InternalTransition* internal;
+    UINT internalCount;
+} SM_AnalyzeMachine;
+
+typedef enum
+{
+    SM_ISSUE_UNREACHABLE,       // state can't be reached
+    SM_ISSUE_DEAD_END,          // state is reachable and can never be left
+    SM_ISSUE_CANNOT_HAPPEN,     // event happens in state and faults
+    SM_ISSUE_INTERNAL_CYCLE,    // cycle of automatic transitions through states
+    SM_ISSUE_BAD_TARGET         // cell of state and event, or superstate, names no state
+} SM_IssueType;
+
+// Event of an SM_ISSUE_BAD_TARGET that is an automatic transition
+#define SM_ANALYZE_INTERNAL     0xFF
+// Event of an SM_ISSUE_BAD_TARGET that is a state's superstate
+#define SM_ANALYZE_PARENT       0xFE
+
+typedef struct
+{
+    SM_IssueType type;
+    SM_StateId state;
+    BYTE event;
+    const SM_StateId* cycle;    // SM_ISSUE_INTERNAL_CYCLE only, the states
+    UINT cycleLength;           // on the cycle
+} SM_Issue;
+
+typedef void (*SM_IssueFunc)(void* context, const SM_AnalyzeMachine* machine, const SM_Issue* issue);
+
+/// Analyze a state machine. Not reentrant.
+/// @param[in] machine - the state machine to analyze
+/// @param[in] report - called once per issue found, may be NULL
+/// @param[in] context - passed to report
+/// @return The number of issues found.
+UINT SM_Analyze(const SM_AnalyzeMachine* machine, SM_IssueFunc report, void* context);
+
+/// Get a state name for a report.
+/// @return The state name, or NULL if the machine has no names.
+const CHAR* SM_AnalyzeStateName(const SM_AnalyzeMachine* machine, SM_StateId state);
+
+/// Get an event name for a report.
+/// @return The event name, or NULL if the machine has no names.
+const CHAR* SM_AnalyzeEventName(const SM_AnalyzeMachine* machine, BYTE event);
+
+// Automatic transition list entry, see the _INTERNAL lists generated by
+// tools/sm_gen.py
+#define SM_X_INTERNAL(_from_, _to_) \
+    { _from_, _to_ },
+
+// Guarded transition list entry, see SM_X_GUARDED. Only the states and
+// event are needed, not the guard and action functions.
+#define SM_X_GUARDED_ANALYZE(_state_, _event_, _guard_, _action_, _newState_) \
+    { _state_, _event_, NULL, NULL, _newState_ },
+
+// Defines the analysis input _smName_##Analyze of a machine from its single
+// source lists, see SM_MACHINE_TABLE. Only the lists are needed, not the
+// state functions, so the machine can be analyzed on a host. Also defines the
+// machine's state and event enumerations.
+#define SM_ANALYZE_DEFINE(_smName_, _states_, _events_, _guarded_, _internal_) \
+    _SM_ANALYZE_TABLES(_smName_, _states_, _events_, _guarded_) \
+    static const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        _smName_##MaxStates, NULL, NULL, _smName_##MaxEvents, \
+        &_smName_##Transitions[0][0], \
+        _smName_##StateNames, _smName_##EventNames, NULL, NULL, NULL, \
+        NULL, NULL, NULL, NULL, NULL, _SM_GUARDED(_smName_) }; \
+    _SM_ANALYZE_INTERNAL(_smName_, _internal_)
+
+// Defines the analysis input of a hierarchical machine, see SM_MACHINE_HSM
+#define SM_ANALYZE_DEFINE_HSM(_smName_, _states_, _events_, _parents_, _guarded_, _internal_) \
+    _SM_ANALYZE_TABLES(_smName_, _states_, _events_, _guarded_) \
+    static const BYTE _smName_##Parents[_smName_##MaxStates] = { _parents_(SM_X_PARENT) }; \
+    static const SM_StateMachineConst _smName_##Const = { #_smName_, \
+        _smName_##MaxStates, NULL, NULL, _smName_##MaxEvents, \
+        &_smName_##Transitions[0][0], \
+        _smName_##StateNames, _smName_##EventNames, _smName_##Parents, NULL, NULL, \
+        NULL, NULL, NULL, NULL, NULL, _SM_GUARDED(_smName_) }; \
+    _SM_ANALYZE_INTERNAL(_smName_, _internal_)
+
+#define _SM_ANALYZE_TABLES(_smName_, _states_, _events_, _guarded_) \
+    enum { _states_(SM_X_STATE_ENUM) _smName_##MaxStates }; \
+    enum { _events_(SM_X_EVENT_ENUM) _smName_##MaxEvents }; \
+    BEGIN_TRANSITION_TABLE(_smName_, _smName_##MaxEvents) \
+        _states_(SM_X_ROW) \
+    END_TRANSITION_TABLE(_smName_) \
+    static const CHAR* const _smName_##StateNames[] = { _states_(SM_X_STATE_NAME) }; \
+    static const CHAR* const _smName_##EventNames[] = { _events_(SM_X_EVENT_NAME) }; \
+    static const SM_GuardedTransition _smName_##Guarded[] = { \
+        _guarded_(SM_X_GUARDED_ANALYZE) { 0, 0, NULL, NULL, 0 } };
+
+#define _SM_ANALYZE_INTERNAL(_smName_, _internal_) \
+    static const SM_InternalTransition _smName_##Internal[] = { \
+        _internal_(SM_X_INTERNAL) { 0, 0 } }; \
+    const SM_AnalyzeMachine _smName_##Analyze = { &_smName_##Const, _smName_##Internal, \
+        (sizeof(_smName_##Internal)/sizeof(_smName_##Internal[0])) - 1 };
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_ANALYZE_H
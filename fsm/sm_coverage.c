@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Fault.h"
+#include "sm_coverage.h"
+
+#ifdef SM_PORT_HOST
+// Host builds log to stdout
+#define NRF_LOG_INFO(...)       (printf(__VA_ARGS__), printf("\n"))
+#define NRF_LOG_PUSH(_str_)     (_str_)
+#define NRF_LOG_FLUSH()
+#else
+#define NRF_LOG_MODULE_NAME     fsm_cov
+#define NRF_LOG_LEVEL           3
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+NRF_LOG_MODULE_REGISTER();
+#endif
+
+// Counters logged per line of a row
+#define SM_COVERAGE_COLUMNS     8
+
+static const UINT32* _SM_Counters(const SM_StateMachineConst* selfConst)
+{
+    ASSERT_TRUE(selfConst);
+    ASSERT_TRUE(selfConst->transitions || selfConst->transitions16 || selfConst->sparse);
+    ASSERT_TRUE(selfConst->coverage);
+
+    return selfConst->coverage;
+}
+
+// Reads cell i of the transition table, whatever its form
+static SM_StateId _SM_CellAt(const SM_StateMachineConst* selfConst, UINT i)
+{
+    return _SM_TableCell(selfConst, (SM_StateId)(i / selfConst->maxEvents), (BYTE)(i % selfConst->maxEvents));
+}
+
+UINT32 SM_CoverageCount(const SM_StateMachineConst* selfConst, UINT16 state, BYTE eventId)
+{
+    const UINT32* counters = _SM_Counters(selfConst);
+
+    ASSERT_TRUE(state < selfConst->maxStates);
+    ASSERT_TRUE(eventId < selfConst->maxEvents);
+
+    return counters[(state * selfConst->maxEvents) + eventId];
+}
+
+UINT SM_CoverageSummarize(const SM_StateMachineConst* selfConst, SM_CoverageSummary* pSummary)
+{
+    const UINT32* counters = _SM_Counters(selfConst);
+    const UINT cells = (UINT)selfConst->maxStates * selfConst->maxEvents;
+    UINT i;
+
+    ASSERT_TRUE(pSummary);
+    memset(pSummary, 0, sizeof(*pSummary));
+
+    for (i = 0; i < cells; i++)
+    {
+        switch (_SM_CellAt(selfConst, i))
+        {
+        case EVENT_IGNORED_16:
+            pSummary->ignored += counters[i];
+            break;
+
+        case SM_DEFER_16:
+            pSummary->deferred += counters[i];
+            break;
+
+        case SM_INHERIT_16:
+            pSummary->inherited += counters[i];
+            break;
+
+        case CANNOT_HAPPEN_16:
+            pSummary->cannotHappen += counters[i];
+            break;
+
+        default:
+            pSummary->transitions++;
+            pSummary->taken += counters[i];
+            if (counters[i])
+                pSummary->transitionsHit++;
+            break;
+        }
+    }
+
+    return pSummary->transitions - pSummary->transitionsHit;
+}
+
+void SM_CoverageDump(const SM_StateMachineConst* selfConst)
+{
+    const UINT32* counters = _SM_Counters(selfConst);
+    SM_CoverageSummary summary;
+    CHAR line[SM_COVERAGE_COLUMNS * 11 + 1];
+    UINT state, event;
+
+    SM_CoverageSummarize(selfConst, &summary);
+    NRF_LOG_INFO("%s: %u of %u transitions taken, %u hits",
+        selfConst->name, summary.transitionsHit, summary.transitions, summary.taken);
+    NRF_LOG_INFO("%s: ignored %u, deferred %u, inherited %u, cannot happen %u",
+        selfConst->name, summary.ignored, summary.deferred, summary.inherited, summary.cannotHappen);
+
+    // One line of counters per row, in event order
+    for (state = 0; state < selfConst->maxStates; state++)
+    {
+        for (event = 0; event < selfConst->maxEvents; event += SM_COVERAGE_COLUMNS)
+        {
+            UINT len = 0;
+            UINT column;
+
+            for (column = 0; column < SM_COVERAGE_COLUMNS && event + column < selfConst->maxEvents; column++)
+            {
+                len += (UINT)snprintf(&line[len], sizeof(line) - len, " %10u",
+                    (UINT)counters[(state * selfConst->maxEvents) + event + column]);
+            }
+
+            if (selfConst->stateNames)
+                NRF_LOG_INFO("%s[%u]:%s", selfConst->stateNames[state], event, NRF_LOG_PUSH(line));
+            else
+                NRF_LOG_INFO("%u[%u]:%s", state, event, NRF_LOG_PUSH(line));
+            NRF_LOG_FLUSH();
+        }
+    }
+
+    // Transitions never taken
+    for (state = 0; state < selfConst->maxStates; state++)
+    {
+        for (event = 0; event < selfConst->maxEvents; event++)
+        {
+            UINT i = (state * selfConst->maxEvents) + event;
+            SM_StateId cell = _SM_CellAt(selfConst, i);
+
+            if ((cell >= selfConst->maxStates && cell != SM_GUARDED_16) || counters[i])
+                continue;
+
+            if (selfConst->stateNames && selfConst->eventNames)
+                NRF_LOG_INFO("%s: %s %s -> %s never taken", selfConst->name,
+                    selfConst->stateNames[state], selfConst->eventNames[event],
+                    cell == SM_GUARDED_16 ? "SM_GUARDED" : selfConst->stateNames[cell]);
+            else
+                NRF_LOG_INFO("%s: %u %u -> %u never taken", selfConst->name, state, event, cell);
+            NRF_LOG_FLUSH();
+        }
+    }
+}
+
+void SM_CoverageClear(const SM_StateMachineConst* selfConst)
+{
+    (void)_SM_Counters(selfConst);
+    memset(selfConst->coverage, 0, (size_t)selfConst->maxStates * selfConst->maxEvents * sizeof(UINT32));
+}
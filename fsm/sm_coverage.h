@@ -0,0 +1,70 @@
+// Transition coverage of table mode state machines.
+//
+// With USE_SM_COVERAGE defined every table mode machine gets a counter per
+// transition table cell, and each table mode event increments the counter of
+// the cell that handles it, whether the cell is a transition, EVENT_IGNORED,
+// SM_DEFER or CANNOT_HAPPEN. An event a state inherits with SM_INHERIT counts
+// on the superstate cell it resolves to, so an SM_INHERIT cell only counts
+// events no superstate handles. Counting is one atomic increment per event.
+// The counters of a machine are shared by all of its instances and regions.
+//
+// Cells that name a state and were never hit are transitions a soak test
+// didn't exercise, rows never hit at all are states whose table row may be
+// dead flash. SM_CoverageDump logs the counters, over RTT with the RTT log
+// backend.
+
+#ifndef _SM_COVERAGE_H
+#define _SM_COVERAGE_H
+
+#include "DataTypes.h"
+#include "StateMachine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hits of the cells of a machine by kind of cell
+typedef struct
+{
+    UINT transitions;           // Cells that name a state or are SM_GUARDED
+    UINT transitionsHit;        // Of those, cells hit at least once
+    UINT32 taken;               // Hits of cells that name a state
+    UINT32 ignored;             // Hits of EVENT_IGNORED cells
+    UINT32 deferred;            // Hits of SM_DEFER cells
+    UINT32 inherited;           // Events no superstate handled
+    UINT32 cannotHappen;        // Hits of CANNOT_HAPPEN cells
+} SM_CoverageSummary;
+
+// Coverage of the machine _machine_, defined in this file or declared with
+// SM_DECLARE_CONST
+#define SM_CoverageOf(_machine_) \
+    (&_machine_##Const)
+
+/// Get the hit count of a transition table cell.
+/// @param[in] selfConst - the machine, see SM_CoverageOf
+/// @param[in] state - the state, the table row
+/// @param[in] eventId - the event, the table column
+/// @return The number of times the event was sent in the state.
+UINT32 SM_CoverageCount(const SM_StateMachineConst* selfConst, UINT16 state, BYTE eventId);
+
+/// Summarize the coverage of a machine.
+/// @param[in] selfConst - the machine
+/// @param[out] pSummary - the summary
+/// @return The number of transitions never taken, 0 when every transition
+///     of the machine has been exercised.
+UINT SM_CoverageSummarize(const SM_StateMachineConst* selfConst, SM_CoverageSummary* pSummary);
+
+/// Log the coverage of a machine: the summary, the counters of each row and
+/// each transition never taken.
+/// @param[in] selfConst - the machine
+void SM_CoverageDump(const SM_StateMachineConst* selfConst);
+
+/// Clear the counters of a machine.
+/// @param[in] selfConst - the machine
+void SM_CoverageClear(const SM_StateMachineConst* selfConst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_COVERAGE_H
@@ -0,0 +1,11 @@
+#include "sm_cycles.h"
+
+void SM_CyclesAdd(SM_CycleStats* pStats, UINT32 cycles)
+{
+    if (pStats->count == 0 || cycles < pStats->min)
+        pStats->min = cycles;
+    if (cycles > pStats->max)
+        pStats->max = cycles;
+    pStats->sum += cycles;
+    pStats->count++;
+}
@@ -0,0 +1,36 @@
+// SM_CYCLES() statistics of function calls.
+//
+// Shared by the per state profile, see sm_profile.h, and the worst case
+// execution time tables, see sm_wcet.h, so either builds without the other.
+// SM_PORT_INIT must have started the cycle counter before the first call is
+// timed.
+
+#ifndef _SM_CYCLES_H
+#define _SM_CYCLES_H
+
+#include "DataTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// SM_CYCLES() of the calls of one function
+typedef struct
+{
+    UINT32 count;               // Calls
+    UINT32 min;                 // SM_CYCLES() of the quickest call
+    UINT32 max;                 // SM_CYCLES() of the slowest call
+    UINT64 sum;                 // SM_CYCLES() of all calls
+} SM_CycleStats;
+
+/// Add the cycles of a call to the timings of a function. Not locked, the
+/// caller serializes the updates of pStats.
+/// @param[in] pStats - the timings
+/// @param[in] cycles - SM_CYCLES() spent in the call
+void SM_CyclesAdd(SM_CycleStats* pStats, UINT32 cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_CYCLES_H
@@ -0,0 +1,107 @@
+// Platform layer for the StateMachine module. The FSM sources reach the
+// RTOS and the processor only through the macros defined here.
+//
+// Define SM_PORT_HOST to build the FSM sources on a development host with
+// no RTOS and no interrupts.
+
+#ifndef _SM_PORT_H
+#define _SM_PORT_H
+
+#ifdef SM_PORT_HOST
+
+    // A host build is single threaded, there is nothing to mask or lock
+    typedef unsigned int SM_InterruptMask;
+
+    #define SM_CRITICAL_ENTER()
+    #define SM_CRITICAL_EXIT()
+    #define SM_INTERRUPTS_MASK()            0
+    #define SM_INTERRUPTS_RESTORE(_mask_)   (void)(_mask_)
+
+    #define SM_CONTEXT_ID()                 ((void*)1)
+
+    #define SM_MUTEX_CREATE()               ((void*)1)
+    #define SM_MUTEX_DELETE(_mutex_)        (void)(_mutex_)
+    #define SM_MUTEX_TRY_TAKE(_mutex_)      TRUE
+    #define SM_MUTEX_TAKE(_mutex_)          (void)(_mutex_)
+    #define SM_MUTEX_GIVE(_mutex_)          (void)(_mutex_)
+
+    #ifndef SM_TIMESTAMP
+    #define SM_TIMESTAMP()                  0
+    #endif
+
+    // Stands in for the cycle counter with a monotonic clock in
+    // nanoseconds, so host timings are comparable with each other
+    #ifndef SM_CYCLES
+    #include <time.h>
+    static inline UINT32 _SM_HostCycles(void)
+    {
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (UINT32)((UINT64)now.tv_sec * 1000000000u + (UINT64)now.tv_nsec);
+    }
+    #define SM_CYCLES()                     _SM_HostCycles()
+    #define SM_CYCLES_INIT()                ((void)0)
+    #endif
+
+#else
+
+    #include "FreeRTOS.h"
+    #include "task.h"
+    #include "semphr.h"
+    #include "nrf.h"
+
+    typedef UBaseType_t SM_InterruptMask;
+
+    // Masks every interrupt that may call into the FSM module and returns
+    // the previous mask. Safe to use from both task and interrupt context.
+    #define SM_INTERRUPTS_MASK()            portSET_INTERRUPT_MASK_FROM_ISR()
+    #define SM_INTERRUPTS_RESTORE(_mask_)   portCLEAR_INTERRUPT_MASK_FROM_ISR(_mask_)
+
+    // Critical section using the mask above. Enter and exit must be paired
+    // in the same scope, and only one pair may be used per scope.
+    #define SM_CRITICAL_ENTER() \
+        SM_InterruptMask _smCriticalMask = SM_INTERRUPTS_MASK()
+    #define SM_CRITICAL_EXIT() \
+        SM_INTERRUPTS_RESTORE(_smCriticalMask)
+
+    // Identifies the calling task
+    #define SM_CONTEXT_ID()                 ((void*)xTaskGetCurrentTaskHandle())
+
+    // Mutex used by the SM_LOCK_MUTEX policy. Task context only.
+    #define SM_MUTEX_CREATE()               ((void*)xSemaphoreCreateMutex())
+    #define SM_MUTEX_DELETE(_mutex_)        vSemaphoreDelete((SemaphoreHandle_t)(_mutex_))
+    #define SM_MUTEX_TRY_TAKE(_mutex_)      (xSemaphoreTake((SemaphoreHandle_t)(_mutex_), 0) == pdTRUE)
+    #define SM_MUTEX_TAKE(_mutex_)          (void)xSemaphoreTake((SemaphoreHandle_t)(_mutex_), portMAX_DELAY)
+    #define SM_MUTEX_GIVE(_mutex_)          (void)xSemaphoreGive((SemaphoreHandle_t)(_mutex_))
+
+    // Time stamp of trace records, in RTOS ticks unless the application
+    // provides a finer clock. Safe to use from both task and interrupt
+    // context.
+    #ifndef SM_TIMESTAMP
+    #define SM_TIMESTAMP()                  ((UINT32)xTaskGetTickCountFromISR())
+    #endif
+
+    // Processor cycle counter used to time state functions, the DWT cycle
+    // counter of the Cortex-M4. SM_PORT_INIT starts it, it runs without a
+    // debugger attached.
+    #ifndef SM_CYCLES
+    #define SM_CYCLES()                     ((UINT32)DWT->CYCCNT)
+    #define SM_CYCLES_INIT() \
+        do { \
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; \
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; \
+        } while (0)
+    #endif
+
+#endif
+
+#ifndef SM_CYCLES_INIT
+#define SM_CYCLES_INIT()                    ((void)0)
+#endif
+
+// Starts the platform layer, the cycle counter. Call once at startup, before
+// any state machine runs.
+#define SM_PORT_INIT()                      SM_CYCLES_INIT()
+
+#endif // _SM_PORT_H
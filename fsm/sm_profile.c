@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "Fault.h"
+#include "sm_profile.h"
+#include "sm_port.h"
+
+// Profile ID of a state machine that found no free profile
+#define SM_PROFILE_NONE         0xFF
+
+C_ASSERT_GLOBAL(SM_ProfileMachines, SM_PROFILE_MACHINES < SM_PROFILE_NONE);
+
+SM_ProfileLog_t SM_ProfileLog;
+
+// Assigns the next profile ID to a state machine, keeps its name and starts
+// the residency clock of its current state
+static BYTE _SM_ProfileAssign(BYTE* pProfileId, const CHAR* name)
+{
+    BYTE id;
+
+    SM_CRITICAL_ENTER();
+    id = *pProfileId;
+    if (id == 0)
+    {
+        if (SM_ProfileLog.machineCount < SM_PROFILE_MACHINES)
+        {
+            id = ++SM_ProfileLog.machineCount;
+            strncpy(SM_ProfileLog.names[id - 1], name ? name : "", SM_PROFILE_NAME_SIZE - 1);
+            SM_ProfileLog.names[id - 1][SM_PROFILE_NAME_SIZE - 1] = '\0';
+            SM_ProfileLog.entered[id - 1] = SM_TIMESTAMP();
+        }
+        else
+        {
+            id = SM_PROFILE_NONE;
+            SM_ProfileLog.machinesDropped++;
+        }
+        *pProfileId = id;
+    }
+    SM_CRITICAL_EXIT();
+
+    return id;
+}
+
+void SM_ProfileRegister(BYTE* pProfileId, const CHAR* name)
+{
+    if (*pProfileId == 0)
+        (void)_SM_ProfileAssign(pProfileId, name);
+}
+
+// Counts an entry or run of a state beyond SM_PROFILE_STATES. Machines run in
+// different contexts share the counter.
+static void _SM_ProfileDropped(void)
+{
+    __atomic_fetch_add(&SM_ProfileLog.statesDropped, 1, __ATOMIC_RELAXED);
+}
+
+// Only the context running a state machine updates its profile, so the
+// counters need no lock
+void SM_ProfileEnter(BYTE* pProfileId, const CHAR* name, UINT16 from, UINT16 to)
+{
+    BYTE id = *pProfileId;
+    UINT32 now;
+
+    if (id == 0)
+        id = _SM_ProfileAssign(pProfileId, name);
+    if (id == SM_PROFILE_NONE || from == to)
+        return;
+
+    // Residency counts from the state machine's registration
+    now = SM_TIMESTAMP();
+    if (from < SM_PROFILE_STATES)
+        SM_ProfileLog.states[id - 1][from].residency += now - SM_ProfileLog.entered[id - 1];
+    SM_ProfileLog.entered[id - 1] = now;
+    if (to < SM_PROFILE_STATES)
+        SM_ProfileLog.states[id - 1][to].entries++;
+    else
+        _SM_ProfileDropped();
+}
+
+void SM_ProfileRun(BYTE profileId, UINT16 state, UINT32 cycles)
+{
+    if (profileId == 0 || profileId == SM_PROFILE_NONE)
+        return;
+    if (state >= SM_PROFILE_STATES)
+    {
+        _SM_ProfileDropped();
+        return;
+    }
+
+    SM_CyclesAdd(&SM_ProfileLog.states[profileId - 1][state].cycles, cycles);
+}
+
+BOOL SM_ProfileRead(BYTE profileId, UINT16 state, UINT16 currentState, SM_StateProfile* pProfile)
+{
+    ASSERT_TRUE(pProfile);
+
+    if (profileId == 0 || profileId == SM_PROFILE_NONE || state >= SM_PROFILE_STATES)
+        return FALSE;
+
+    {
+        SM_CRITICAL_ENTER();
+        *pProfile = SM_ProfileLog.states[profileId - 1][state];
+        if (state == currentState)
+            pProfile->residency += SM_TIMESTAMP() - SM_ProfileLog.entered[profileId - 1];
+        SM_CRITICAL_EXIT();
+    }
+
+    pProfile->cyclesAvg = pProfile->cycles.count ? (UINT32)(pProfile->cycles.sum / pProfile->cycles.count) : 0;
+
+    return TRUE;
+}
+
+void SM_ProfileClear(void)
+{
+    UINT32 now = SM_TIMESTAMP();
+    UINT i;
+
+    SM_CRITICAL_ENTER();
+    memset(SM_ProfileLog.states, 0, sizeof(SM_ProfileLog.states));
+    SM_ProfileLog.statesDropped = 0;
+    for (i = 0; i < SM_PROFILE_MACHINES; i++)
+        SM_ProfileLog.entered[i] = now;
+    SM_CRITICAL_EXIT();
+}
@@ -0,0 +1,119 @@
+// Per state profile of state machines.
+//
+// With USE_SM_PROFILE defined the state engines count, for every state of
+// every state machine, how often the state is entered and its state function
+// run, how long the machine stays in the state in SM_TIMESTAMP() ticks, and
+// the SM_CYCLES() spent in the state function. Residency tells which states
+// dominate wall time, state function cycles which dominate the CPU.
+//
+// The counters live in the single variable SM_ProfileLog, so the
+// application can read them at run time with SM_GetProfile and report them
+// however it likes, e.g. over a CLI or BLE.
+//
+// A state machine gets its profile when it is first sent an event, and the
+// residency of its initial state counts from then. Call SM_ProfileStart at
+// startup to count it from there instead. States beyond SM_PROFILE_STATES
+// and machines beyond SM_PROFILE_MACHINES aren't profiled, SM_ProfileLog
+// counts what they miss.
+
+#ifndef _SM_PROFILE_H
+#define _SM_PROFILE_H
+
+#include "DataTypes.h"
+#include "sm_cycles.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum number of state machines, and regions, that get their own profile.
+// Further state machines are not profiled.
+#ifndef SM_PROFILE_MACHINES
+#define SM_PROFILE_MACHINES     8
+#endif
+
+// States profiled per state machine, higher states are not profiled. Raise
+// it to the state count of the largest machine profiled.
+#ifndef SM_PROFILE_STATES
+#define SM_PROFILE_STATES       16
+#endif
+
+// Bytes of each state machine name kept with its profile
+#ifndef SM_PROFILE_NAME_SIZE
+#define SM_PROFILE_NAME_SIZE    8
+#endif
+
+// Profile of one state
+typedef struct
+{
+    UINT32 entries;             // Transitions into the state
+    UINT32 residency;           // SM_TIMESTAMP() ticks spent in the state
+    SM_CycleStats cycles;       // State function calls
+    UINT32 cyclesAvg;           // Filled in by SM_ProfileRead only
+} SM_StateProfile;
+
+typedef struct
+{
+    BYTE machineCount;          // Profile IDs assigned, IDs start at 1
+    UINT32 machinesDropped;     // State machines that found no free profile
+    UINT32 statesDropped;       // Entries and runs of states not profiled
+    UINT32 entered[SM_PROFILE_MACHINES];    // SM_TIMESTAMP() of the last state change
+    SM_StateProfile states[SM_PROFILE_MACHINES][SM_PROFILE_STATES];
+    CHAR names[SM_PROFILE_MACHINES][SM_PROFILE_NAME_SIZE];
+} SM_ProfileLog_t;
+
+extern SM_ProfileLog_t SM_ProfileLog;
+
+// Read the profile of state _state_ of a state machine into the
+// SM_StateProfile at _pProfile_. Evaluates to FALSE if the state isn't
+// profiled.
+#define SM_GetProfile(_smName_, _state_, _pProfile_) \
+    SM_ProfileRead(_smName_##Obj.profileId, _state_, _smName_##Obj.currentState, _pProfile_)
+
+// Assign a state machine its profile and start the residency clock of its
+// current state, if it hasn't got a profile yet
+#define SM_ProfileStart(_smName_) \
+    SM_ProfileRegister(&_smName_##Obj.profileId, _smName_##Obj.name)
+
+// Read the profile of a state of region _region_ of a state machine defined
+// with SM_DEFINE_REGIONS, see SM_GetProfile
+#define SM_GetRegionProfile(_smName_, _region_, _state_, _pProfile_) \
+    SM_ProfileRead(_smName_##Regions[_region_].profileId, _state_, \
+        _smName_##Regions[_region_].currentState, _pProfile_)
+
+/// Assign a state machine its profile ID, keep its name and start the
+/// residency clock of its current state. Does nothing if it has an ID.
+/// @param[in] pProfileId - the state machine's profile ID
+/// @param[in] name - the state machine's name, kept with its profile ID
+void SM_ProfileRegister(BYTE* pProfileId, const CHAR* name);
+
+/// Record a state change.
+/// @param[in] pProfileId - the state machine's profile ID, assigned on first use
+/// @param[in] name - the state machine's name, kept with its profile ID
+/// @param[in] from - current state
+/// @param[in] to - new state, the same as from for a transition to itself
+void SM_ProfileEnter(BYTE* pProfileId, const CHAR* name, UINT16 from, UINT16 to);
+
+/// Record a state function call.
+/// @param[in] profileId - the state machine's profile ID
+/// @param[in] state - the state whose function was called
+/// @param[in] cycles - SM_CYCLES() spent in the state function
+void SM_ProfileRun(BYTE profileId, UINT16 state, UINT32 cycles);
+
+/// Read the profile of a state. The residency includes the time spent so far
+/// in the current state.
+/// @param[in] profileId - the state machine's profile ID
+/// @param[in] state - the state
+/// @param[in] currentState - the state machine's current state
+/// @param[out] pProfile - the profile
+/// @return TRUE if the state is profiled, FALSE otherwise.
+BOOL SM_ProfileRead(BYTE profileId, UINT16 state, UINT16 currentState, SM_StateProfile* pProfile);
+
+/// Clear the profiles of all state machines. Profile IDs are kept.
+void SM_ProfileClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_PROFILE_H
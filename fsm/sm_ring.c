@@ -0,0 +1,166 @@
+#include "Fault.h"
+#include "sm_ring.h"
+#include "sm_port.h"
+
+// A slot's sequence number, stored less the slot index, is the ticket of
+// the producer that may claim it while the slot is free, and that ticket
+// plus one once the event in it is published. Tickets count the slots ever
+// claimed, the low bits of a ticket are its slot.
+
+BOOL _SM_RingPost(SM_EventRing* pRing, BYTE eventId, void* pEventData)
+{
+    UINT32 mask;
+    UINT32 tail;
+    SM_RingEntry* pEntry;
+
+    ASSERT_TRUE(pRing);
+    ASSERT_TRUE(pRing->machine);
+
+    mask = pRing->size - 1;
+    tail = __atomic_load_n(&pRing->tail, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        INT32 lag;
+
+        pEntry = &pRing->entries[tail & mask];
+        lag = (INT32)(__atomic_load_n(&pEntry->sequence, __ATOMIC_ACQUIRE) + (tail & mask) - tail);
+        if (lag == 0)
+        {
+            // Free, claim it unless another producer got there first. A
+            // failed claim reloads the tail.
+            if (__atomic_compare_exchange_n(&pRing->tail, &tail, tail + 1, TRUE,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if (lag < 0)
+        {
+            // Still holds an event of the previous lap, the ring is full.
+            // The ring owns the event data, drop it along with the event.
+            __atomic_fetch_add(&pRing->dropped, 1, __ATOMIC_RELAXED);
+            if (pEventData)
+                _SM_FreeEventData(pRing->machine, pEventData);
+            return FALSE;
+        }
+        else
+        {
+            // Claimed by another producer since the tail was read
+            tail = __atomic_load_n(&pRing->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    pEntry->pEventData = pEventData;
+    pEntry->eventId = eventId;
+    __atomic_store_n(&pEntry->sequence, tail + 1 - (tail & mask), __ATOMIC_SEQ_CST);
+
+    // The consumer stops at the first slot not yet published. If it is still
+    // at this slot it may have stopped here, wake it.
+    if (pRing->wake && __atomic_load_n(&pRing->head, __ATOMIC_SEQ_CST) == tail)
+        pRing->wake(pRing);
+
+    return TRUE;
+}
+
+// Records the SM_CYCLES() an event took, at least 1 so a measured event is
+// told apart from one never measured
+static void _SM_RingMeasured(SM_EventRing* pRing, BYTE eventId, UINT32 cycles)
+{
+    if (cycles == 0)
+        cycles = 1;
+    if (cycles > pRing->cycles[eventId])
+        pRing->cycles[eventId] = cycles;
+}
+
+// Returns TRUE if an event may run directly: nothing is waiting on the ring
+// to run before it, the state machine is free and the event has been
+// measured and always fit the budget
+static BOOL _SM_RingDirect(SM_EventRing* pRing, BYTE eventId)
+{
+    if (pRing->cycles == NULL || pRing->cycles[eventId] == 0 || pRing->cycles[eventId] > pRing->budget)
+        return FALSE;
+
+    return __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE) &&
+        !pRing->machine->running;
+}
+
+BOOL _SM_RingDispatch(SM_EventRing* pRing, BYTE eventId, void* pEventData)
+{
+    UINT32 cycles;
+
+    ASSERT_TRUE(pRing);
+    ASSERT_TRUE(pRing->machine);
+    ASSERT_TRUE(pRing->machine->selfConst);
+    ASSERT_TRUE(eventId < pRing->machine->selfConst->maxEvents);
+
+    if (!_SM_RingDirect(pRing, eventId))
+    {
+        __atomic_fetch_add(&pRing->deferred, 1, __ATOMIC_RELAXED);
+        return _SM_RingPost(pRing, eventId, pEventData);
+    }
+
+    // Interrupts may only send events to state machines that don't block
+    ASSERT_TRUE(pRing->machine->lockPolicy == SM_LOCK_TRYPOST || pRing->machine->lockPolicy == SM_LOCK_CRITICAL);
+
+    // A state machine acquired by another context since the check queues
+    // the event for that context, which is still quick
+    cycles = SM_CYCLES();
+    _SM_Dispatch(pRing->machine, eventId, pEventData);
+    cycles = SM_CYCLES() - cycles;
+
+    _SM_RingMeasured(pRing, eventId, cycles);
+    __atomic_fetch_add(&pRing->direct, 1, __ATOMIC_RELAXED);
+
+    return TRUE;
+}
+
+UINT _SM_RingRun(SM_EventRing* pRing)
+{
+    UINT32 mask;
+    UINT32 head;
+    UINT count = 0;
+
+    ASSERT_TRUE(pRing);
+    ASSERT_TRUE(pRing->machine);
+
+    mask = pRing->size - 1;
+    head = pRing->head;
+    for (;;)
+    {
+        SM_RingEntry* pEntry = &pRing->entries[head & mask];
+        void* pEventData;
+        BYTE eventId;
+
+        if (__atomic_load_n(&pEntry->sequence, __ATOMIC_SEQ_CST) + (head & mask) != head + 1)
+            break;
+
+        pEventData = pEntry->pEventData;
+        eventId = pEntry->eventId;
+
+        // Free the slot for the next lap before running the event, which may
+        // post more events. The head moves on only once the event has run,
+        // so SM_RingDispatch doesn't see an empty ring and run a newer event
+        // ahead of it.
+        __atomic_store_n(&pEntry->sequence, head + pRing->size - (head & mask), __ATOMIC_RELEASE);
+
+        // Measure the events of a direct ring as they run here, so
+        // SM_RingDispatch knows their cost before running one directly. A
+        // state machine busy in another context queues the event, which
+        // measures nothing.
+        if (pRing->cycles && !pRing->machine->running)
+        {
+            UINT32 cycles = SM_CYCLES();
+
+            _SM_Dispatch(pRing->machine, eventId, pEventData);
+            _SM_RingMeasured(pRing, eventId, SM_CYCLES() - cycles);
+        }
+        else
+        {
+            _SM_Dispatch(pRing->machine, eventId, pEventData);
+        }
+        count++;
+
+        head++;
+        __atomic_store_n(&pRing->head, head, __ATOMIC_SEQ_CST);
+    }
+
+    return count;
+}
@@ -0,0 +1,134 @@
+// Lock free event ring for table mode state machines.
+//
+// An event ring queues table mode events for one state machine instance
+// from any number of tasks and interrupts without masking interrupts or
+// taking a lock. A producer claims a slot with one compare and swap of the
+// ring's tail, an LDREX/STREX pair on the Cortex-M4, fills it in and
+// publishes it with a store of the slot's sequence number. An interrupt that
+// preempts another producer claims the next slot and never waits for it.
+//
+// One context, the consumer, runs the ring with SM_RingRun, which sends the
+// events to the state machine in the order their slots were claimed. A slot
+// claimed but not yet published stops the run until its producer finishes.
+//
+// A producer whose event may find the consumer done calls the ring's wake
+// hook, e.g. to notify the consumer task with vTaskNotifyGiveFromISR. Events
+// posted while the consumer is still running wake nobody, it runs them.
+//
+// A ring defined with SM_DEFINE_RING_DIRECT also lets SM_RingDispatch run
+// an event at once in the posting context, typically an interrupt, instead
+// of waking the consumer task. The event runs directly if the ring is empty,
+// the state machine isn't running and the worst SM_CYCLES() the event has
+// taken so far is within the ring's cycle budget, otherwise it is posted.
+// An event is posted until the consumer has run it once and measured it,
+// and an event that takes longer than the budget is posted from then on.
+// SM_PORT_INIT must have started the cycle counter. Only state machines
+// whose state functions are interrupt safe, locked with SM_LOCK_TRYPOST or
+// SM_LOCK_CRITICAL, may be run directly.
+//
+// The ring owns posted event data. Event data is allocated as for
+// SM_Dispatch, and released along with an event dropped as the ring is full.
+
+#ifndef _SM_RING_H
+#define _SM_RING_H
+
+#include "DataTypes.h"
+#include "StateMachine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct SM_EventRing;
+
+// Wakes the consumer of a ring. Called from the posting context, which may
+// be an interrupt.
+typedef void (*SM_RingWakeFunc)(struct SM_EventRing* pRing);
+
+// A slot of an event ring. The sequence number is stored less the slot
+// index, so a zeroed ring is empty.
+typedef struct
+{
+    UINT32 sequence;
+    void* pEventData;
+    BYTE eventId;
+} SM_RingEntry;
+
+typedef struct SM_EventRing
+{
+    SM_RingEntry* entries;
+    UINT32 size;                // Slots, a power of two
+    UINT32 tail;                // Next slot to claim, written by producers
+    UINT32 head;                // Next slot to run, written by the consumer
+    SM_StateMachine* machine;   // State machine the events are sent to
+    SM_RingWakeFunc wake;       // Wakes the consumer, or NULL
+    void* pWakeContext;         // For the wake hook, e.g. a task handle
+    UINT32 dropped;             // Events dropped as the ring was full
+    UINT32 budget;              // SM_CYCLES() an event may take to run directly
+    UINT32* cycles;             // Worst SM_CYCLES() of each event, 0 if never run, or NULL
+    UINT32 direct;              // Events run directly by SM_RingDispatch
+    UINT32 deferred;            // Events SM_RingDispatch posted instead
+} SM_EventRing;
+
+// Defines the event ring of state machine instance _smName_ with _size_
+// slots, a power of two. _wake_ may be NULL.
+#define SM_DEFINE_RING(_smName_, _size_, _wake_, _wakeContext_) \
+    C_ASSERT_GLOBAL(_smName_##RingSize, ((_size_) & ((_size_) - 1)) == 0); \
+    static SM_RingEntry _smName_##RingEntries[_size_]; \
+    SM_EventRing _smName_##Ring = { _smName_##RingEntries, _size_, 0, 0, \
+        &_smName_##Obj, _wake_, _wakeContext_, 0 };
+
+// Defines the event ring of state machine instance _smName_, see
+// SM_DEFINE_RING, whose events with IDs below _maxEvents_ may be run
+// directly by SM_RingDispatch when they take at most _budget_ SM_CYCLES()
+#define SM_DEFINE_RING_DIRECT(_smName_, _size_, _wake_, _wakeContext_, _budget_, _maxEvents_) \
+    C_ASSERT_GLOBAL(_smName_##RingSize, ((_size_) & ((_size_) - 1)) == 0); \
+    static SM_RingEntry _smName_##RingEntries[_size_]; \
+    static UINT32 _smName_##RingCycles[_maxEvents_]; \
+    SM_EventRing _smName_##Ring = { _smName_##RingEntries, _size_, 0, 0, \
+        &_smName_##Obj, _wake_, _wakeContext_, 0, _budget_, _smName_##RingCycles, 0, 0 };
+
+// Queue a table mode event on the event ring of a state machine. Safe from
+// any task or interrupt. Evaluates to FALSE, and releases the event data, if
+// the ring is full.
+#define SM_RingPost(_smName_, _eventId_, _eventData_) \
+    _SM_RingPost(&_smName_##Ring, _eventId_, _eventData_)
+
+// Run a table mode event in the calling context if it fits the cycle
+// budget of the event ring of a state machine, otherwise queue it on the
+// ring, see SM_DEFINE_RING_DIRECT. Safe from any task or interrupt.
+// Evaluates to FALSE, and releases the event data, if the ring is full.
+#define SM_RingDispatch(_smName_, _eventId_, _eventData_) \
+    _SM_RingDispatch(&_smName_##Ring, _eventId_, _eventData_)
+
+// Send the events on the event ring of a state machine to it. Consumer
+// context only. Evaluates to the number of events sent.
+#define SM_RingRun(_smName_) \
+    _SM_RingRun(&_smName_##Ring)
+
+/// Queue a table mode event on an event ring.
+/// @param[in] pRing - the event ring
+/// @param[in] eventId - the event
+/// @param[in] pEventData - event data, or NULL
+/// @return TRUE if queued, FALSE if the ring is full.
+BOOL _SM_RingPost(SM_EventRing* pRing, BYTE eventId, void* pEventData);
+
+/// Run a table mode event directly if it fits the cycle budget of an event
+/// ring, otherwise queue it on the ring.
+/// @param[in] pRing - the event ring
+/// @param[in] eventId - the event
+/// @param[in] pEventData - event data, or NULL
+/// @return TRUE if run or queued, FALSE if the ring is full.
+BOOL _SM_RingDispatch(SM_EventRing* pRing, BYTE eventId, void* pEventData);
+
+/// Send the events on an event ring to its state machine, oldest first,
+/// until the ring is empty or the next event isn't published yet.
+/// @param[in] pRing - the event ring
+/// @return The number of events sent.
+UINT _SM_RingRun(SM_EventRing* pRing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_RING_H
@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include "crc16.h"
+
+#include "Fault.h"
+#include "sm_snapshot.h"
+#include "sm_port.h"
+
+// Fingerprints the constant data of a machine so a blob isn't restored into
+// a different machine, or one whose tables have changed
+static UINT16 _SM_Fingerprint(const SM_StateMachineConst* selfConst)
+{
+    UINT16 crc = 0xFFFF;
+    BYTE sizes[3];
+    UINT i;
+
+    sizes[0] = (BYTE)selfConst->maxStates;
+    sizes[1] = (BYTE)(selfConst->maxStates >> 8);
+    sizes[2] = selfConst->maxEvents;
+    crc = crc16_compute(sizes, sizeof(sizes), &crc);
+    if (selfConst->name)
+        crc = crc16_compute((const uint8_t*)selfConst->name, (uint32_t)strlen(selfConst->name), &crc);
+    if (selfConst->transitions)
+        crc = crc16_compute(selfConst->transitions, (uint32_t)selfConst->maxStates * selfConst->maxEvents, &crc);
+    if (selfConst->transitions16)
+        crc = crc16_compute((const uint8_t*)selfConst->transitions16,
+            (uint32_t)selfConst->maxStates * selfConst->maxEvents * sizeof(UINT16), &crc);
+    if (selfConst->sparse)
+    {
+        crc = crc16_compute((const uint8_t*)selfConst->sparse->base, selfConst->maxStates * sizeof(UINT16), &crc);
+        crc = crc16_compute(selfConst->sparse->defaults, selfConst->maxStates, &crc);
+        crc = crc16_compute(selfConst->sparse->check, selfConst->sparse->cells, &crc);
+        crc = crc16_compute(selfConst->sparse->next, selfConst->sparse->cells, &crc);
+    }
+    if (selfConst->parents)
+        crc = crc16_compute(selfConst->parents, selfConst->maxStates, &crc);
+    if (selfConst->history)
+        crc = crc16_compute(selfConst->history, selfConst->maxStates, &crc);
+    for (i = 0; i < selfConst->guardedCount; i++)
+    {
+        const SM_GuardedTransition* pGuarded = &selfConst->guarded[i];
+        BYTE guarded[5];
+
+        // The guard and action addresses change with every build
+        guarded[0] = (BYTE)pGuarded->state;
+        guarded[1] = (BYTE)(pGuarded->state >> 8);
+        guarded[2] = pGuarded->eventId;
+        guarded[3] = (BYTE)pGuarded->newState;
+        guarded[4] = (BYTE)(pGuarded->newState >> 8);
+        crc = crc16_compute(guarded, sizeof(guarded), &crc);
+    }
+
+    return crc;
+}
+
+// CRC-16 of a blob, covering everything after the crc field
+static UINT16 _SM_BlobCrc(const SM_SnapshotHeader* pHeader, size_t size)
+{
+    const BYTE* start = (const BYTE*)&pHeader->crc + sizeof(pHeader->crc);
+
+    return crc16_compute(start, (uint32_t)(size - (size_t)(start - (const BYTE*)pHeader)), NULL);
+}
+
+UINT _SM_Snapshot(SM_StateMachine* self, size_t instanceSize, void* pBlob, size_t blobSize)
+{
+    SM_SnapshotHeader* pHeader = (SM_SnapshotHeader*)pBlob;
+    const size_t size = SM_SNAPSHOT_SIZE(instanceSize);
+    BOOL idle;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(self->selfConst);
+    ASSERT_TRUE(self->regions == NULL);
+    ASSERT_TRUE(pBlob);
+    ASSERT_TRUE(instanceSize == 0 || self->pInstance);
+
+    if (blobSize < size || size > 0xFFFF)
+        return 0;
+
+    memset(pHeader, 0, sizeof(*pHeader));
+
+    // Copy the state in one go so it is consistent, a running state machine
+    // or one with events still to run is between states
+    {
+        SM_CRITICAL_ENTER();
+        idle = !self->running && !self->queueCount && !self->deferredCount && !self->eventDataBusy;
+        if (idle)
+        {
+            pHeader->currentState = self->currentState;
+            memcpy(pHeader->history, self->history, sizeof(pHeader->history));
+            if (instanceSize)
+                memcpy(pHeader + 1, self->pInstance, instanceSize);
+        }
+        SM_CRITICAL_EXIT();
+    }
+
+    if (!idle)
+        return 0;
+
+    pHeader->magic = SM_SNAPSHOT_MAGIC;
+    pHeader->size = (UINT16)size;
+    pHeader->machine = _SM_Fingerprint(self->selfConst);
+    pHeader->instanceSize = (UINT16)instanceSize;
+    pHeader->version = SM_SNAPSHOT_VERSION;
+    pHeader->crc = _SM_BlobCrc(pHeader, size);
+
+    return (UINT)size;
+}
+
+BOOL _SM_Restore(SM_StateMachine* self, size_t instanceSize, const void* pBlob, size_t blobSize)
+{
+    const SM_SnapshotHeader* pHeader = (const SM_SnapshotHeader*)pBlob;
+    const size_t size = SM_SNAPSHOT_SIZE(instanceSize);
+    BOOL restored = FALSE;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(self->selfConst);
+    ASSERT_TRUE(self->regions == NULL);
+    ASSERT_TRUE(pBlob);
+    ASSERT_TRUE(instanceSize == 0 || self->pInstance);
+
+    // Check the header before trusting its size for the CRC
+    if (blobSize < size ||
+        pHeader->magic != SM_SNAPSHOT_MAGIC ||
+        pHeader->size != size ||
+        pHeader->instanceSize != instanceSize ||
+        pHeader->version != SM_SNAPSHOT_VERSION ||
+        pHeader->crc != _SM_BlobCrc(pHeader, size) ||
+        pHeader->machine != _SM_Fingerprint(self->selfConst) ||
+        pHeader->currentState >= self->selfConst->maxStates)
+        return FALSE;
+
+    {
+        SM_CRITICAL_ENTER();
+        if (!self->running && !self->queueCount)
+        {
+            self->currentState = pHeader->currentState;
+            // A machine without history has none to restore, whatever the blob
+            // holds
+            if (self->selfConst->history)
+                memcpy(self->history, pHeader->history, sizeof(self->history));
+            else
+                memset(self->history, 0, sizeof(self->history));
+            if (instanceSize)
+                memcpy(self->pInstance, pHeader + 1, instanceSize);
+            restored = TRUE;
+        }
+        SM_CRITICAL_EXIT();
+    }
+
+    return restored;
+}
@@ -0,0 +1,83 @@
+// Snapshots of table mode state machines.
+//
+// SM_Snapshot serializes a state machine's current state and history along
+// with its instance data into a compact blob protected by a CRC-16.
+// SM_Restore loads the blob back into the state machine after a reset, so it
+// continues from where it was instead of replaying the events that led
+// there. Keep the blob in RAM that survives a warm reset, e.g. the .non_init
+// section, or write it to flash as an fds record.
+//
+// A blob is only restored into the same machine it was taken from: the
+// machine's name, tables and history are fingerprinted and the instance data must be
+// of the same size. Pointers in the instance data, such as timer handles,
+// are not valid after a reset and must be fixed up by the caller before
+// SM_Reenter runs the current state function again to restore its outputs.
+//
+// Only idle state machines without regions are snapshot, a machine that is
+// running or has queued or deferred events is refused.
+
+#ifndef _SM_SNAPSHOT_H
+#define _SM_SNAPSHOT_H
+
+#include "DataTypes.h"
+#include "StateMachine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SM_SNAPSHOT_MAGIC       0x50534D53  // "SMSP"
+#define SM_SNAPSHOT_VERSION     2
+
+// Blob header, the instance data follows it
+typedef struct
+{
+    UINT32 magic;
+    UINT16 crc;                 // CRC-16 of the blob after this field
+    UINT16 size;                // Bytes of the whole blob
+    UINT16 machine;             // Fingerprint of the machine's constant data
+    UINT16 instanceSize;        // Bytes of instance data
+    UINT16 currentState;
+    UINT16 history[SM_HSM_HISTORY_SLOTS];
+    BYTE version;
+} SM_SnapshotHeader;
+
+// Bytes of the blob of a state machine with _instanceSize_ bytes of instance
+// data
+#define SM_SNAPSHOT_SIZE(_instanceSize_) \
+    (sizeof(SM_SnapshotHeader) + (_instanceSize_))
+
+// Take a snapshot of a state machine and _instanceSize_ bytes of its
+// instance data. Evaluates to the size of the blob, or 0 if the state
+// machine is busy or the blob is too small.
+#define SM_Snapshot(_smName_, _instanceSize_, _pBlob_, _blobSize_) \
+    _SM_Snapshot(&_smName_##Obj, _instanceSize_, _pBlob_, _blobSize_)
+
+// Restore a state machine from a snapshot. Evaluates to FALSE, leaving the
+// state machine untouched, if the blob is corrupt or doesn't match it.
+#define SM_Restore(_smName_, _instanceSize_, _pBlob_, _blobSize_) \
+    _SM_Restore(&_smName_##Obj, _instanceSize_, _pBlob_, _blobSize_)
+
+/// Take a snapshot of a state machine.
+/// @param[in] self - the state machine
+/// @param[in] instanceSize - bytes of instance data to keep
+/// @param[out] pBlob - the blob
+/// @param[in] blobSize - bytes available at pBlob
+/// @return The size of the blob, 0 if the state machine is busy or the blob
+///     is too small.
+UINT _SM_Snapshot(SM_StateMachine* self, size_t instanceSize, void* pBlob, size_t blobSize);
+
+/// Restore a state machine from a snapshot. Call before the state machine
+/// is sent any event, then fix up the instance data and call SM_Reenter.
+/// @param[in] self - the state machine
+/// @param[in] instanceSize - bytes of instance data
+/// @param[in] pBlob - the blob
+/// @param[in] blobSize - bytes available at pBlob
+/// @return TRUE if restored, FALSE if the blob is corrupt or doesn't match.
+BOOL _SM_Restore(SM_StateMachine* self, size_t instanceSize, const void* pBlob, size_t blobSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_SNAPSHOT_H
@@ -0,0 +1,69 @@
+#include <string.h>
+
+#include "Fault.h"
+#include "sm_trace.h"
+#include "sm_port.h"
+
+C_ASSERT_GLOBAL(SM_TraceRecordsPowerOfTwo, (SM_TRACE_RECORDS & (SM_TRACE_RECORDS - 1)) == 0);
+C_ASSERT_GLOBAL(SM_TraceRecordSize, sizeof(SM_TraceRecord) == 16);
+
+SM_TraceLog_t SM_TraceLog = {
+    SM_TRACE_MAGIC, sizeof(SM_TraceRecord), SM_TRACE_RECORDS, SM_TRACE_NAME_SIZE
+};
+
+// Assigns the next trace ID to a state machine and keeps its name
+static BYTE _SM_TraceAssign(BYTE* pTraceId, const CHAR* name)
+{
+    BYTE id;
+
+    SM_CRITICAL_ENTER();
+    id = *pTraceId;
+    if (id == 0)
+    {
+        if (SM_TraceLog.machineCount < SM_TRACE_MACHINES)
+        {
+            id = ++SM_TraceLog.machineCount;
+            strncpy(SM_TraceLog.names[id - 1], name ? name : "", SM_TRACE_NAME_SIZE);
+        }
+        else
+        {
+            id = SM_TRACE_MACHINES;
+        }
+        *pTraceId = id;
+    }
+    SM_CRITICAL_EXIT();
+
+    return id;
+}
+
+void SM_TraceTransition(BYTE* pTraceId, const CHAR* name, BYTE event, UINT16 from, UINT16 to, UINT16 dataSize)
+{
+    SM_TraceRecord* pRecord;
+    UINT32 number;
+    BYTE id = *pTraceId;
+
+    if (id == 0)
+        id = _SM_TraceAssign(pTraceId, name);
+
+    // Claim a record. A writer that laps a slower one on the same record
+    // leaves a record the decoder drops, the sequence won't match.
+    number = __atomic_fetch_add(&SM_TraceLog.next, 1, __ATOMIC_RELAXED);
+    pRecord = &SM_TraceLog.records[number & (SM_TRACE_RECORDS - 1)];
+
+    __atomic_store_n(&pRecord->sequence, (UINT16)~number, __ATOMIC_RELAXED);
+    pRecord->timestamp = SM_TIMESTAMP();
+    pRecord->machine = id;
+    pRecord->event = event;
+    pRecord->from = from;
+    pRecord->to = to;
+    pRecord->dataSize = dataSize;
+    __atomic_store_n(&pRecord->sequence, (UINT16)number, __ATOMIC_RELEASE);
+}
+
+void SM_TraceClear(void)
+{
+    SM_CRITICAL_ENTER();
+    memset(SM_TraceLog.records, 0, sizeof(SM_TraceLog.records));
+    SM_TraceLog.next = 0;
+    SM_CRITICAL_EXIT();
+}
@@ -0,0 +1,94 @@
+// Binary transition trace for state machines.
+//
+// With USE_SM_TRACE defined the state engines record every transition and
+// every ignored event of every state machine into a ring of fixed size
+// records in RAM, instead of formatting log messages. Recording is lock free
+// and takes a handful of stores, so it may be left enabled in production and
+// used from any task or interrupt.
+//
+// The ring is the single variable SM_TraceLog. Dump it from a debugger, e.g.
+// with J-Link "savebin trace.bin <address of SM_TraceLog> <sizeof>", and
+// decode the dump with tools/sm_trace.py.
+
+#ifndef _SM_TRACE_H
+#define _SM_TRACE_H
+
+#include "DataTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of records in the ring, a power of two
+#ifndef SM_TRACE_RECORDS
+#define SM_TRACE_RECORDS        64
+#endif
+
+#define SM_TRACE_MAGIC          0x52544D53  // "SMTR"
+
+// Maximum number of state machines that get their own trace ID. Further
+// state machines share the last ID.
+#ifndef SM_TRACE_MACHINES
+#define SM_TRACE_MACHINES       16
+#endif
+
+// Bytes of each state machine name kept in the ring for the decoder
+#ifndef SM_TRACE_NAME_SIZE
+#define SM_TRACE_NAME_SIZE      8
+#endif
+
+// Event ID of a transition made by an event function, which has no ID
+#define SM_TRACE_EVENT_FUNC     0xFF
+// Event ID of a transition made with SM_InternalEvent
+#define SM_TRACE_EVENT_INTERNAL 0xFE
+
+// Data size of event data the state machine did not copy itself
+#define SM_TRACE_SIZE_UNKNOWN   0xFFFF
+
+// One transition. States are full 16 bit state IDs, the destination state
+// is EVENT_IGNORED_16 for an ignored event and SM_DEFER_16 for a deferred
+// one.
+typedef struct
+{
+    UINT32 timestamp;           // SM_TIMESTAMP() when recorded
+    UINT16 sequence;            // Low bits of the record number, written last
+    BYTE machine;               // Trace ID of the state machine
+    BYTE event;                 // Event ID
+    UINT16 from;                // State before the transition
+    UINT16 to;                  // State after the transition
+    UINT16 dataSize;            // Event data size in bytes
+    UINT16 reserved;
+} SM_TraceRecord;
+
+typedef struct
+{
+    UINT32 magic;
+    UINT16 recordSize;
+    UINT16 recordCount;
+    BYTE nameSize;
+    BYTE machineCount;          // Trace IDs assigned, IDs start at 1
+    UINT16 reserved;
+    UINT32 next;                // Number of records ever started
+    SM_TraceRecord records[SM_TRACE_RECORDS];
+    CHAR names[SM_TRACE_MACHINES][SM_TRACE_NAME_SIZE];
+} SM_TraceLog_t;
+
+extern SM_TraceLog_t SM_TraceLog;
+
+/// Record a state machine transition.
+/// @param[in] pTraceId - the state machine's trace ID, assigned on first use
+/// @param[in] name - the state machine's name, kept with its trace ID
+/// @param[in] event - event ID, or one of the SM_TRACE_EVENT_xxx values
+/// @param[in] from - current state
+/// @param[in] to - new state, EVENT_IGNORED_16 or SM_DEFER_16
+/// @param[in] dataSize - event data size, 0 for none
+void SM_TraceTransition(BYTE* pTraceId, const CHAR* name, BYTE event, UINT16 from, UINT16 to, UINT16 dataSize);
+
+/// Discard all records.
+void SM_TraceClear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_TRACE_H
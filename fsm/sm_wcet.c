@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "Fault.h"
+#include "StateMachine.h"
+#include "sm_wcet.h"
+#include "sm_port.h"
+
+#ifdef SM_PORT_HOST
+#include <stdio.h>
+// Host builds log to stdout
+#define NRF_LOG_INFO(...)       (printf(__VA_ARGS__), printf("\n"))
+#define NRF_LOG_FLUSH()
+#else
+#define NRF_LOG_MODULE_NAME     fsm_wcet
+#define NRF_LOG_LEVEL           3
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+NRF_LOG_MODULE_REGISTER();
+#endif
+
+static const CHAR* const _SM_WcetKindNames[SM_WCET_KINDS] = {
+    "state", "guard", "entry", "exit", "action"
+};
+
+static SM_WcetTable* _SM_WcetTable(const SM_StateMachineConst* selfConst)
+{
+    ASSERT_TRUE(selfConst);
+    ASSERT_TRUE(selfConst->wcet);
+
+    return selfConst->wcet;
+}
+
+// Adds a sample. The instances of a machine may run in different contexts,
+// so the update is one critical section.
+static void _SM_WcetAdd(SM_WcetStats* pStats, UINT32 value)
+{
+    SM_CRITICAL_ENTER();
+    SM_CyclesAdd(pStats, value);
+    SM_CRITICAL_EXIT();
+}
+
+static void _SM_WcetCopy(SM_WcetStats* pCopy, const SM_WcetStats* pStats)
+{
+    SM_CRITICAL_ENTER();
+    *pCopy = *pStats;
+    SM_CRITICAL_EXIT();
+}
+
+void SM_WcetRecord(SM_WcetTable* pTable, UINT16 state, BYTE kind, UINT32 cycles)
+{
+    if (pTable == NULL)
+        return;
+
+    _SM_WcetAdd(&pTable->functions[((UINT)state * SM_WCET_KINDS) + kind], cycles);
+}
+
+void SM_WcetChain(SM_WcetTable* pTable, UINT16 length, UINT32 cycles)
+{
+    if (pTable == NULL)
+        return;
+
+    _SM_WcetAdd(&pTable->chainCycles, cycles);
+    _SM_WcetAdd(&pTable->chainLength, length);
+}
+
+BOOL SM_WcetRead(const SM_StateMachineConst* selfConst, UINT16 state, BYTE kind, SM_WcetStats* pStats)
+{
+    SM_WcetTable* pTable = _SM_WcetTable(selfConst);
+
+    ASSERT_TRUE(state < selfConst->maxStates);
+    ASSERT_TRUE(kind < SM_WCET_KINDS);
+    ASSERT_TRUE(pStats);
+
+    _SM_WcetCopy(pStats, &pTable->functions[((UINT)state * SM_WCET_KINDS) + kind]);
+
+    return pStats->count != 0;
+}
+
+void SM_WcetReadChain(const SM_StateMachineConst* selfConst, SM_WcetStats* pCycles, SM_WcetStats* pLength)
+{
+    SM_WcetTable* pTable = _SM_WcetTable(selfConst);
+
+    ASSERT_TRUE(pCycles);
+    ASSERT_TRUE(pLength);
+
+    _SM_WcetCopy(pCycles, &pTable->chainCycles);
+    _SM_WcetCopy(pLength, &pTable->chainLength);
+}
+
+// nrf_log takes at most 6 arguments, so each entry is logged over two lines
+void SM_WcetDump(const SM_StateMachineConst* selfConst)
+{
+    SM_WcetStats cycles, length;
+    UINT state;
+    BYTE kind;
+
+    SM_WcetReadChain(selfConst, &cycles, &length);
+    if (cycles.count)
+    {
+        NRF_LOG_INFO("%s: %u steps, cycles min %u max %u avg %u", selfConst->name,
+            cycles.count, cycles.min, cycles.max, (UINT32)(cycles.sum / cycles.count));
+        NRF_LOG_INFO("%s: states per step min %u max %u avg %u", selfConst->name,
+            length.min, length.max, (UINT32)(length.sum / length.count));
+        NRF_LOG_FLUSH();
+    }
+
+    for (state = 0; state < selfConst->maxStates; state++)
+    {
+        for (kind = 0; kind < SM_WCET_KINDS; kind++)
+        {
+            SM_WcetStats stats;
+
+            if (!SM_WcetRead(selfConst, (UINT16)state, kind, &stats))
+                continue;
+
+            if (selfConst->stateNames)
+                NRF_LOG_INFO("%s: %s %s %u calls", selfConst->name,
+                    selfConst->stateNames[state], _SM_WcetKindNames[kind], stats.count);
+            else
+                NRF_LOG_INFO("%s: %u %s %u calls", selfConst->name,
+                    state, _SM_WcetKindNames[kind], stats.count);
+            NRF_LOG_INFO("%s:   cycles min %u max %u avg %u", selfConst->name,
+                stats.min, stats.max, (UINT32)(stats.sum / stats.count));
+            NRF_LOG_FLUSH();
+        }
+    }
+}
+
+void SM_WcetClear(const SM_StateMachineConst* selfConst)
+{
+    SM_WcetTable* pTable = _SM_WcetTable(selfConst);
+
+    SM_CRITICAL_ENTER();
+    memset(pTable->functions, 0, (size_t)selfConst->maxStates * SM_WCET_KINDS * sizeof(SM_WcetStats));
+    memset(&pTable->chainCycles, 0, sizeof(pTable->chainCycles));
+    memset(&pTable->chainLength, 0, sizeof(pTable->chainLength));
+    SM_CRITICAL_EXIT();
+}
@@ -0,0 +1,100 @@
+// Worst case execution time of state machine functions.
+//
+// With USE_SM_WCET defined every machine gets a table of SM_CYCLES() timings
+// with a row per state and a column per kind of function, see SM_WcetKind,
+// and the state engines time every state function, guard, entry action,
+// exit action and guarded transition action they call. Each entry keeps the
+// number of calls and the minimum, maximum and sum of their cycles. A guard
+// or action of a transition is timed in the row of the state the transition
+// goes to.
+//
+// Each event sent to a machine also times its run to completion step, the
+// event and the chain of internal events it raises, and counts the state
+// functions run by the chain.
+//
+// On the target SM_CYCLES() is the DWT cycle counter, on a host build a
+// monotonic clock in nanoseconds. The timings of a machine are shared by all
+// of its instances and regions, and include any interrupts taken during the
+// call. SM_PORT_INIT starts the cycle counter, so the first call is timed
+// too. SM_WcetDump logs them, SM_WcetRead reads them for export.
+
+#ifndef _SM_WCET_H
+#define _SM_WCET_H
+
+#include "DataTypes.h"
+#include "sm_cycles.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct SM_StateMachineConst;
+
+// Kinds of functions timed, the columns of a machine's table
+typedef enum
+{
+    SM_WCET_STATE,              // State function
+    SM_WCET_GUARD,              // Guard of a transition to the state
+    SM_WCET_ENTRY,              // Entry action
+    SM_WCET_EXIT,               // Exit action
+    SM_WCET_ACTION,             // Action of a guarded transition to the state
+    SM_WCET_KINDS
+} SM_WcetKind;
+
+// Timings of one function, kept by SM_CyclesAdd
+typedef SM_CycleStats SM_WcetStats;
+
+// Timings of one machine
+typedef struct SM_WcetTable
+{
+    SM_WcetStats* functions;    // Row per state, column per SM_WcetKind
+    SM_WcetStats chainCycles;   // SM_CYCLES() of each run to completion step
+    SM_WcetStats chainLength;   // State functions run by each step
+} SM_WcetTable;
+
+// Timings of the machine _machine_, defined in this file or declared with
+// SM_DECLARE_CONST
+#define SM_WcetOf(_machine_) \
+    (&_machine_##Const)
+
+/// Record the cycles of a function call. Called by the state engines.
+/// @param[in] pTable - the machine's timings, or NULL
+/// @param[in] state - the state, the table row
+/// @param[in] kind - the kind of function, the table column
+/// @param[in] cycles - SM_CYCLES() spent in the call
+void SM_WcetRecord(SM_WcetTable* pTable, UINT16 state, BYTE kind, UINT32 cycles);
+
+/// Record a run to completion step. Called by the state engines.
+/// @param[in] pTable - the machine's timings, or NULL
+/// @param[in] length - state functions run by the step
+/// @param[in] cycles - SM_CYCLES() spent in the step
+void SM_WcetChain(SM_WcetTable* pTable, UINT16 length, UINT32 cycles);
+
+/// Read the timings of a function of a machine.
+/// @param[in] selfConst - the machine, see SM_WcetOf
+/// @param[in] state - the state
+/// @param[in] kind - the kind of function
+/// @param[out] pStats - the timings
+/// @return TRUE if the function was called, FALSE otherwise.
+BOOL SM_WcetRead(const struct SM_StateMachineConst* selfConst, UINT16 state, BYTE kind, SM_WcetStats* pStats);
+
+/// Read the timings of the run to completion steps of a machine.
+/// @param[in] selfConst - the machine
+/// @param[out] pCycles - the cycles of each step
+/// @param[out] pLength - the state functions run by each step
+void SM_WcetReadChain(const struct SM_StateMachineConst* selfConst, SM_WcetStats* pCycles, SM_WcetStats* pLength);
+
+/// Log the timings of a machine: the run to completion steps, then each
+/// function called at least once.
+/// @param[in] selfConst - the machine
+void SM_WcetDump(const struct SM_StateMachineConst* selfConst);
+
+/// Clear the timings of a machine.
+/// @param[in] selfConst - the machine
+void SM_WcetClear(const struct SM_StateMachineConst* selfConst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SM_WCET_H
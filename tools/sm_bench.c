@@ -0,0 +1,164 @@
+// Host benchmark of the state engines.
+//
+// Dispatches go and stop events to the machine of sm_bench_machine.c built
+// with the standard state engine and with the generated switch engine, and
+// prints the best time per event of each over several runs. Each go event
+// runs four states.
+//
+// Then compares the dense and the row displaced transition table of the
+// large machine of sm_bench_big.c: the flash each table takes, the time per
+// table lookup and the time per event dispatched, with the same pseudo
+// random states and events for both.
+//
+//   sm_bench [EVENTS]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "StateMachine.h"
+
+SM_DECLARE_CONST(BenchTable)
+SM_DECLARE_CONST(BenchSwitch)
+
+SM_DEFINE_TABLE(TABLE, NULL, BenchTable, 1, SM_LOCK_NONE)
+SM_DEFINE_TABLE(SWITCH, NULL, BenchSwitch, 1, SM_LOCK_NONE)
+
+SM_DECLARE_CONST(BenchDense)
+SM_DECLARE_CONST(BenchSparse)
+
+SM_DEFINE_TABLE(DENSE, NULL, BenchDense, 1, SM_LOCK_NONE)
+SM_DEFINE_TABLE(SPARSE, NULL, BenchSparse, 1, SM_LOCK_NONE)
+
+// Pseudo random lookups of the large machine
+enum { LOOKUPS = 4096 };
+static SM_StateId lookupStates[LOOKUPS];
+static BYTE lookupEvents[LOOKUPS];
+
+volatile UINT benchWork;
+
+void FaultHandler(const char* file, unsigned short line)
+{
+    fprintf(stderr, "Assert failed: %s:%d\n", file, line);
+    abort();
+}
+
+// Returns the time per event in nanoseconds
+static double run(SM_StateMachine* machine, UINT events)
+{
+    struct timespec start, end;
+    UINT i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < events; i += 2)
+    {
+        _SM_Dispatch(machine, 0, NULL);
+        _SM_Dispatch(machine, 1, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / events;
+}
+
+// Returns the time per transition table lookup in nanoseconds
+static double lookup(const SM_StateMachineConst* selfConst, UINT lookups)
+{
+    struct timespec start, end;
+    UINT i, sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++)
+        sum += _SM_TableCell(selfConst, lookupStates[i % LOOKUPS], lookupEvents[i % LOOKUPS]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    benchWork += sum;
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / lookups;
+}
+
+// Returns the time per pseudo random event in nanoseconds
+static double dispatch(SM_StateMachine* machine, UINT events)
+{
+    struct timespec start, end;
+    UINT i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < events; i++)
+        _SM_Dispatch(machine, lookupEvents[i % LOOKUPS], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / events;
+}
+
+// Flash taken by the transition table of a machine
+static UINT table_bytes(const SM_StateMachineConst* selfConst)
+{
+    if (selfConst->sparse)
+        return selfConst->maxStates * (UINT)(sizeof(UINT16) + sizeof(BYTE)) + selfConst->sparse->cells * 2U;
+    return (UINT)selfConst->maxStates * selfConst->maxEvents;
+}
+
+int main(int argc, char* argv[])
+{
+    enum { RUNS = 5 };
+    UINT events = 2000000;
+    double table = 1e9, engine = 1e9;
+    double denseLookup = 1e9, sparseLookup = 1e9, dense = 1e9, sparse = 1e9;
+    UINT i;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: sm_bench [EVENTS]\n");
+        return 2;
+    }
+    if (argc == 2)
+        events = (UINT)atoi(argv[1]) & ~1U;
+    if (events == 0)
+        return 2;
+
+    // Alternate the engines so both see the same machine conditions
+    for (i = 0; i < RUNS; i++)
+    {
+        double ns = run(&TABLEObj, events);
+
+        if (ns < table)
+            table = ns;
+        ns = run(&SWITCHObj, events);
+        if (ns < engine)
+            engine = ns;
+    }
+
+    printf("%u events, 4 states per go event\n", events);
+    printf("state map engine  %6.1f ns/event\n", table);
+    printf("switch engine     %6.1f ns/event  (%.2fx)\n", engine, table / engine);
+
+    srand(1);
+    for (i = 0; i < LOOKUPS; i++)
+    {
+        lookupStates[i] = (SM_StateId)(rand() % BenchDenseConst.maxStates);
+        lookupEvents[i] = (BYTE)(rand() % BenchDenseConst.maxEvents);
+    }
+
+    for (i = 0; i < RUNS; i++)
+    {
+        double ns = lookup(&BenchDenseConst, events);
+
+        if (ns < denseLookup)
+            denseLookup = ns;
+        ns = lookup(&BenchSparseConst, events);
+        if (ns < sparseLookup)
+            sparseLookup = ns;
+        ns = dispatch(&DENSEObj, events);
+        if (ns < dense)
+            dense = ns;
+        ns = dispatch(&SPARSEObj, events);
+        if (ns < sparse)
+            sparse = ns;
+    }
+
+    printf("%u states, %u events\n", BenchDenseConst.maxStates, BenchDenseConst.maxEvents);
+    printf("dense table     %6u bytes  %6.1f ns/lookup  %6.1f ns/event\n",
+        table_bytes(&BenchDenseConst), denseLookup, dense);
+    printf("row displaced   %6u bytes  %6.1f ns/lookup  %6.1f ns/event\n",
+        table_bytes(&BenchSparseConst), sparseLookup, sparse);
+    return 0;
+}
@@ -0,0 +1,35 @@
+// Large benchmark state machine for tools/sm_bench.c, generated by
+// sm_bench_dot.py and sm_gen.py --sparse. Built once with the dense
+// transition table and once row displaced, see SM_MACHINE_SPARSE, with
+// BENCH_MACHINE naming the machine.
+
+#include "StateMachine.h"
+#include "bench_big_def.h"
+
+enum { BENCH_BIG_EVENTS(SM_X_EVENT_ENUM) BENCH_BIG_EV_MAX_EVENTS };
+enum { BENCH_BIG_STATES(SM_X_STATE_ENUM) ST_MAX_STATES };
+
+BENCH_BIG_STATES(SM_X_STATE_DECLARE)
+
+// Expands BENCH_MACHINE before it is pasted into the machine's names
+#ifdef BENCH_SPARSE
+#define BENCH_DEFINE(_smName_) \
+    SM_MACHINE_SPARSE(_smName_, BENCH_BIG_STATES, BENCH_BIG_EVENTS, BENCH_BIG_SPARSE_ROWS, \
+        BENCH_BIG_SPARSE_CELLS, BENCH_BIG_EV_MAX_EVENTS)
+#else
+#define BENCH_DEFINE(_smName_) \
+    SM_MACHINE_TABLE(_smName_, BENCH_BIG_STATES, BENCH_BIG_EVENTS, BENCH_BIG_EV_MAX_EVENTS)
+#endif
+
+BENCH_DEFINE(BENCH_MACHINE)
+
+// Work done by the states so they aren't optimized away
+extern volatile UINT benchWork;
+
+#define BENCH_STATE_DEFINE(_state_, _stateFunc_, _eventData_, _row_) \
+    STATE_DEFINE(_stateFunc_, _eventData_) \
+    { \
+        benchWork++; \
+    }
+
+BENCH_BIG_STATES(BENCH_STATE_DEFINE)
@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+"""Write the state diagram of the large benchmark machine of sm_bench.
+
+Every state handles a few of the events, with the same pseudo random
+choices on every run, and ignores the rest, like a large generated machine
+whose transition table is mostly EVENT_IGNORED.
+
+Usage: sm_bench_dot.py [STATES [EVENTS [HANDLED]]] > diagram.dot
+"""
+
+import random
+import sys
+
+
+def main(argv):
+    states, events, handled = ([int(a) for a in argv] + [200, 64, 4][len(argv):])[:3]
+    rand = random.Random(1)
+
+    out = ['digraph bench_big {']
+    for state in range(states):
+        for event in sorted(rand.sample(range(events), handled)):
+            out.append('    state_%d -> state_%d [label="Event %d"];' % (state, rand.randrange(states), event))
+    out.append('}')
+    sys.stdout.write('\n'.join(out) + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
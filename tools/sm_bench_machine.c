@@ -0,0 +1,61 @@
+// Benchmark state machine for tools/sm_bench.c. Built once with the
+// standard state engine and once with the generated switch engine, see
+// USE_SM_SWITCH_ENGINE, with BENCH_MACHINE naming the machine.
+//
+// The go event runs a chain of automatic transitions like the LED machine's
+// ST_REP_START -> ST_PULSE_ON, the stop event makes a single transition.
+
+#include "StateMachine.h"
+
+#define BENCH_EVENTS(X) \
+    X(BENCH_EV_GO,    NoEventData) \
+    X(BENCH_EV_STOP,  NoEventData)
+
+#define BENCH_STATES(X) \
+    X(ST_IDLE,   Idle,  NoEventData,  (ST_HOP_1,       EVENT_IGNORED))  \
+    X(ST_HOP_1,  Hop1,  NoEventData,  (CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_HOP_2,  Hop2,  NoEventData,  (CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_HOP_3,  Hop3,  NoEventData,  (CANNOT_HAPPEN,  CANNOT_HAPPEN))  \
+    X(ST_RUN,    Run,   NoEventData,  (EVENT_IGNORED,  ST_IDLE))
+
+enum { BENCH_EVENTS(SM_X_EVENT_ENUM) BENCH_EV_MAX_EVENTS };
+enum { BENCH_STATES(SM_X_STATE_ENUM) ST_MAX_STATES };
+
+BENCH_STATES(SM_X_STATE_DECLARE)
+
+// Expands BENCH_MACHINE before it is pasted into the machine's names
+#define BENCH_DEFINE(_smName_) \
+    SM_MACHINE_TABLE(_smName_, BENCH_STATES, BENCH_EVENTS, BENCH_EV_MAX_EVENTS)
+
+BENCH_DEFINE(BENCH_MACHINE)
+
+// Work done by the states so they aren't optimized away
+extern volatile UINT benchWork;
+
+STATE_DEFINE(Idle, NoEventData)
+{
+    benchWork++;
+}
+
+STATE_DEFINE(Hop1, NoEventData)
+{
+    benchWork++;
+    SM_InternalEvent(ST_HOP_2, NULL);
+}
+
+STATE_DEFINE(Hop2, NoEventData)
+{
+    benchWork++;
+    SM_InternalEvent(ST_HOP_3, NULL);
+}
+
+STATE_DEFINE(Hop3, NoEventData)
+{
+    benchWork++;
+    SM_InternalEvent(ST_RUN, NULL);
+}
+
+STATE_DEFINE(Run, NoEventData)
+{
+    benchWork++;
+}
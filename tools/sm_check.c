@@ -0,0 +1,172 @@
+// Host driver for the state machine static analyzer, see fsm/sm_analyze.h.
+//
+// Analyzes every state machine listed in machines[] and prints one line per
+// issue. Exits with a non-zero status if any issue was found so the build
+// can be gated on it.
+//
+//   sm_check            analyze the machines
+//   sm_check -b STATES  time the analysis of a generated machine
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sm_analyze.h"
+#include "fsm_led_def.h"
+
+SM_ANALYZE_DEFINE_HSM(Led, LED_STATES, LED_EVENTS, LED_PARENTS, LED_GUARDED, LED_INTERNAL)
+
+static const SM_AnalyzeMachine* const machines[] = {
+    &LedAnalyze,
+};
+
+void FaultHandler(const char* file, unsigned short line)
+{
+    fprintf(stderr, "Assert failed: %s:%d\n", file, line);
+    abort();
+}
+
+static void print_state(const SM_AnalyzeMachine* machine, SM_StateId state)
+{
+    const CHAR* name = SM_AnalyzeStateName(machine, state);
+
+    if (name)
+        printf("%s", name);
+    else
+        printf("state %d", state);
+}
+
+static void print_event(const SM_AnalyzeMachine* machine, BYTE event)
+{
+    const CHAR* name = SM_AnalyzeEventName(machine, event);
+
+    if (name)
+        printf("%s", name);
+    else
+        printf("event %d", event);
+}
+
+static void report(void* context, const SM_AnalyzeMachine* machine, const SM_Issue* issue)
+{
+    UINT i;
+
+    printf("%s: ", machine->machine->name);
+    switch (issue->type)
+    {
+    case SM_ISSUE_UNREACHABLE:
+        print_state(machine, issue->state);
+        printf(" is unreachable\n");
+        break;
+
+    case SM_ISSUE_DEAD_END:
+        print_state(machine, issue->state);
+        printf(" can never be left\n");
+        break;
+
+    case SM_ISSUE_CANNOT_HAPPEN:
+        print_event(machine, issue->event);
+        printf(" can happen in ");
+        print_state(machine, issue->state);
+        printf(" but is CANNOT_HAPPEN\n");
+        break;
+
+    case SM_ISSUE_INTERNAL_CYCLE:
+        printf("automatic transitions cycle through");
+        for (i = 0; i < issue->cycleLength; i++)
+        {
+            printf(" ");
+            print_state(machine, issue->cycle[i]);
+        }
+        printf("\n");
+        break;
+
+    case SM_ISSUE_BAD_TARGET:
+        if (issue->event == SM_ANALYZE_INTERNAL)
+        {
+            printf("automatic transition from state %d to no state\n", issue->state);
+        }
+        else if (issue->event == SM_ANALYZE_PARENT)
+        {
+            print_state(machine, issue->state);
+            printf(" has no valid superstate\n");
+        }
+        else
+        {
+            print_state(machine, issue->state);
+            printf(" ");
+            print_event(machine, issue->event);
+            printf(" transitions to no state\n");
+        }
+        break;
+    }
+}
+
+// Times the analysis of a generated machine with the given number of states.
+// Machines that fit a byte table get one, larger machines a 16 bit table.
+static int benchmark(UINT states)
+{
+    enum { EVENTS = 16, RUNS = 100 };
+    static BYTE table[SM_ANALYZE_MAX_STATES * EVENTS];
+    static UINT16 table16[SM_ANALYZE_MAX_STATES * EVENTS];
+    static SM_InternalTransition internal[SM_ANALYZE_MAX_STATES / 2];
+    const BOOL wide = states > SM_GUARDED;
+    const SM_StateMachineConst c = { "Bench", (UINT16)states, NULL, NULL, EVENTS, wide ? NULL : table,
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, wide ? table16 : NULL };
+    SM_AnalyzeMachine machine = { &c, internal, 0 };
+    struct timespec start, end;
+    UINT i, issues = 0;
+    double ms;
+
+    if (states < 2 || states > SM_ANALYZE_MAX_STATES)
+    {
+        fprintf(stderr, "sm_check: 2 to %d states\n", SM_ANALYZE_MAX_STATES);
+        return 2;
+    }
+
+    srand(1);
+    for (i = 0; i < states * EVENTS; i++)
+    {
+        UINT r = rand() % 8;
+
+        if (wide)
+            table16[i] = r == 0 ? CANNOT_HAPPEN_16 : r < 4 ? EVENT_IGNORED_16 : (UINT16)(rand() % states);
+        else
+            table[i] = r == 0 ? CANNOT_HAPPEN : r < 4 ? EVENT_IGNORED : (BYTE)(rand() % states);
+    }
+    for (i = 0; i < states / 2; i++)
+    {
+        internal[machine.internalCount].from = (SM_StateId)(rand() % states);
+        internal[machine.internalCount].to = (SM_StateId)(rand() % states);
+        machine.internalCount++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < RUNS; i++)
+        issues = SM_Analyze(&machine, NULL, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ms = ((end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6) / RUNS;
+    printf("%u states, %d events, %u automatic transitions: %.3f ms, %u issues\n",
+        states, EVENTS, machine.internalCount, ms, issues);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    UINT issues = 0;
+    UINT i;
+
+    if (argc == 3 && strcmp(argv[1], "-b") == 0)
+        return benchmark((UINT)atoi(argv[2]));
+    if (argc != 1)
+    {
+        fprintf(stderr, "usage: sm_check [-b STATES]\n");
+        return 2;
+    }
+
+    for (i = 0; i < sizeof(machines)/sizeof(machines[0]); i++)
+        issues += SM_Analyze(machines[i], report, NULL);
+
+    return issues ? 1 : 0;
+}
@@ -0,0 +1,559 @@
+#!/usr/bin/env python3
+"""Generate a state machine definition header from a Graphviz state diagram.
+
+The diagram is read from a .dot file, which may be a bash script wrapping
+the graph in a here document like docs/fsm_led.dot.  The output is the
+single source definition of a table mode state machine, an event list and a
+state list for SM_MACHINE_TABLE in fsm/StateMachine.h.
+
+Diagram conventions:
+
+    Nodes are states.  Node foo_bar becomes state ST_FOO_BAR with state
+    function FooBar.  A node attribute data="Type" sets the state function's
+    event data type, the default is NoEventData.
+
+    Solid edges are external events.  The event is the edge label, or the
+    edge attribute event="Name" when the label is not a usable name.  Event
+    "Timer Expired" of machine Led becomes LED_EV_TIMER_EXPIRED.  An edge
+    attribute data="Type" sets the event's data type.  Events are numbered in
+    order of first appearance.
+
+    Dashed edges are automatic transitions made with SM_InternalEvent, their
+    label is only a comment.  A dashed edge with an event attribute is an
+    external event drawn dashed.  As edge attributes set with edge [...]
+    carry over to later edges, data="" and event="" clear them.
+
+    Edge attributes guard="Name" and action="Name" make the edge a guarded
+    transition with guard GD_Name and action AC_Name, see SM_GUARDED.  The
+    edges of a state and event with a guard or action are tried in the
+    order drawn, all but the last need a guard.
+
+    A state with automatic transitions and no external events is transient,
+    events can't happen there.  Any other state ignores events it has no
+    edge for.
+
+    Node attribute defer="Event, ..." lists events the state defers instead
+    of ignoring them, see SM_DEFER.  Substates of a cluster inherit them.
+
+    A cluster subgraph cluster_foo is superstate ST_FOO of the states in
+    it.  Edges drawn from the cluster with ltail=cluster_foo are events of
+    the superstate, which its states handle unless they have an edge for
+    the event themselves, transient states excepted.
+
+    Graph attribute actions="entry exit" of a cluster, or node attribute of
+    a state, lists the entry and exit actions EN_Foo and EX_Foo the state
+    has.  Graph attribute history="shallow" or history="deep" of a cluster
+    makes an edge drawn to the cluster with lhead=cluster_foo resume the
+    state last active in it.
+
+A machine with more than 251 states, or any machine with --wide, gets the
+_16 sentinels for the 16 bit transition table of SM_MACHINE_TABLE16.  Such
+a machine can't have superstates.
+
+With --sparse the transition table is also emitted row displaced for
+SM_MACHINE_SPARSE, which keeps only the cells of each row that differ from
+the row's most common cell.  Such a machine can't have superstates either.
+
+Usage: sm_gen.py [-n Name] [-p PREFIX] [--wide | --sparse] [-o output.h [--check]] diagram.dot
+"""
+
+import argparse
+import os
+import re
+import sys
+
+
+class DotError(Exception):
+    pass
+
+
+TOKEN = re.compile(r'''
+      (?P<space>\s+)
+    | (?P<comment>(\#|//)[^\n]*|/\*.*?\*/)
+    | (?P<string>"(?:[^"\\]|\\.)*")
+    | (?P<arrow>->)
+    | (?P<id>[A-Za-z_0-9.]+)
+    | (?P<punct>[\[\]{}=;,])
+''', re.VERBOSE | re.DOTALL)
+
+
+def tokenize(text):
+    pos = 0
+    tokens = []
+    while pos < len(text):
+        m = TOKEN.match(text, pos)
+        if not m:
+            raise DotError('unexpected %r' % text[pos:pos + 20])
+        pos = m.end()
+        kind = m.lastgroup
+        if kind in ('space', 'comment'):
+            continue
+        value = m.group(kind)
+        if kind == 'string':
+            value = value[1:-1].replace('\\n', ' ').replace('\\"', '"')
+            kind = 'id'
+        tokens.append((kind, value))
+    return tokens
+
+
+def extract_graph(text):
+    """Return the digraph out of a plain .dot file or a wrapper script."""
+    m = re.search(r'^\s*digraph\b', text, re.MULTILINE)
+    if not m:
+        raise DotError('no digraph found')
+    depth = 0
+    for i in range(text.index('{', m.start()), len(text)):
+        if text[i] == '{':
+            depth += 1
+        elif text[i] == '}':
+            depth -= 1
+            if depth == 0:
+                return text[m.start():i + 1]
+    raise DotError('unterminated digraph')
+
+
+class Graph(object):
+    def __init__(self):
+        self.name = None
+        self.nodes = []         # node ids in order of appearance
+        self.node_attrs = {}
+        self.edges = []         # (tail, head, attrs) in order of appearance
+        self.parents = {}       # superstate of each state in a cluster
+
+    def add_node(self, node, attrs=None, cluster=None):
+        if node not in self.node_attrs:
+            self.nodes.append(node)
+            self.node_attrs[node] = {}
+        if attrs:
+            self.node_attrs[node].update(attrs)
+        # A node belongs to the cluster it first appears in
+        if cluster and node != cluster and node not in self.parents:
+            self.parents[node] = cluster
+
+
+def parse(text):
+    tokens = tokenize(extract_graph(text))
+    graph = Graph()
+    pos = [0]
+
+    def peek():
+        return tokens[pos[0]] if pos[0] < len(tokens) else (None, None)
+
+    def take(kind=None, value=None):
+        tok = peek()
+        if tok[0] is None or (kind and tok[0] != kind) or (value and tok[1] != value):
+            raise DotError('expected %s, got %r' % (value or kind, tok[1]))
+        pos[0] += 1
+        return tok[1]
+
+    def attr_list():
+        attrs = {}
+        while peek()[1] == '[':
+            take('punct', '[')
+            while peek()[1] != ']':
+                key = take('id')
+                take('punct', '=')
+                attrs[key] = take('id')
+                if peek()[1] in (',', ';'):
+                    take()
+            take('punct', ']')
+        return attrs
+
+    def statements(edge_defaults, cluster):
+        edge_defaults = dict(edge_defaults)
+        while peek()[1] not in ('}', None):
+            tok = peek()
+            if tok[1] in ('{', 'subgraph'):
+                # A cluster is a superstate, other subgraphs only group
+                # nodes for the layout
+                inner = cluster
+                if take() == 'subgraph':
+                    if peek()[0] == 'id':
+                        name = take('id')
+                        if name.startswith('cluster_'):
+                            inner = name[len('cluster_'):]
+                            graph.add_node(inner, cluster=cluster)
+                    take('punct', '{')
+                statements(edge_defaults, inner)
+                take('punct', '}')
+            elif tok[1] in ('graph', 'node', 'edge'):
+                take()
+                attrs = attr_list()
+                if tok[1] == 'edge':
+                    edge_defaults.update(attrs)
+                elif tok[1] == 'graph' and cluster:
+                    graph.add_node(cluster, attrs)
+            else:
+                first = take('id')
+                if peek()[1] == '=':
+                    # Graph attribute such as rankdir or rank, or an
+                    # attribute of the superstate of a cluster
+                    take()
+                    value = take('id')
+                    if cluster:
+                        graph.add_node(cluster, {first: value})
+                elif peek()[0] == 'arrow':
+                    chain = [first]
+                    while peek()[0] == 'arrow':
+                        take()
+                        chain.append(take('id'))
+                    attrs = dict(edge_defaults)
+                    attrs.update(attr_list())
+                    for node in chain:
+                        graph.add_node(node, cluster=cluster)
+                    # Edges drawn from or to a cluster are from or to its
+                    # superstate
+                    for tail, head in zip(chain, chain[1:]):
+                        if attrs.get('ltail', '').startswith('cluster_'):
+                            tail = attrs['ltail'][len('cluster_'):]
+                        if attrs.get('lhead', '').startswith('cluster_'):
+                            head = attrs['lhead'][len('cluster_'):]
+                        graph.edges.append((tail, head, attrs))
+                else:
+                    graph.add_node(first, attr_list(), cluster)
+            if peek()[1] in (';', ','):
+                take()
+
+    take('id', 'digraph')
+    graph.name = take('id')
+    take('punct', '{')
+    statements({}, None)
+    take('punct', '}')
+    return graph
+
+
+def words(text):
+    return re.findall(r'[A-Za-z0-9]+', text)
+
+
+def camel(text):
+    return ''.join(w[0].upper() + w[1:] for w in words(text))
+
+
+def upper(text):
+    return '_'.join(w.upper() for w in words(text))
+
+
+# Cell of an event a state defers
+DEFER = object()
+
+# Cell of an event with guarded transitions
+GUARDED = object()
+
+# Cell of a substate of a state with guarded transitions
+INHERIT = object()
+
+CELLS = {DEFER: 'SM_DEFER', GUARDED: 'SM_GUARDED', INHERIT: 'SM_INHERIT'}
+
+
+class Machine(object):
+    """Event and state lists of a state machine built from its diagram."""
+
+    def __init__(self, graph, name, prefix):
+        self.name = name
+        self.prefix = prefix
+        self.events = []        # (enumerator, data type, comment)
+        self.states = []        # (enumerator, function, data type, comment)
+        self.rows = []          # one list of cells per state
+        self.internal = []      # (from, to, comment)
+        self.parents = []       # (state, superstate)
+        self.actions = []       # (state, entry function, exit function)
+        self.history = []       # (superstate, history kind, history slot)
+        self.guarded = []       # (state, event, guard, action, new state)
+
+        event_index = {}
+        external = {}
+        choices = {}            # guarded edges of each state and event
+        for tail, head, attrs in graph.edges:
+            dashed = 'dashed' in attrs.get('style', '')
+            label = attrs.get('label', '')
+            if dashed and not attrs.get('event'):
+                self.internal.append((self.state(tail), self.state(head), label))
+                continue
+            event = attrs.get('event') or label
+            if not words(event):
+                raise DotError('%s -> %s: edge has no event' % (tail, head))
+            enum = '%s_EV_%s' % (prefix, upper(event))
+            if enum not in event_index:
+                event_index[enum] = len(self.events)
+                self.events.append((enum, attrs.get('data') or 'NoEventData', label or event))
+            cell = (tail, event_index[enum])
+            guard, action = attrs.get('guard'), attrs.get('action')
+            if guard or action or cell in choices:
+                if cell in external and cell not in choices:
+                    raise DotError('%s: event %s is both guarded and not' % (tail, enum))
+                if choices.get(cell) and not choices[cell][-1][0]:
+                    raise DotError('%s: event %s has a transition after the one without a guard' % (tail, enum))
+                choices.setdefault(cell, []).append((guard, action, head))
+                external[cell] = GUARDED
+                continue
+            if cell in external and external[cell] != head:
+                raise DotError('%s: event %s goes to both %s and %s' % (tail, enum, external[cell], head))
+            external[cell] = head
+
+        for (node, event), edges in choices.items():
+            for guard, action, head in edges:
+                self.guarded.append((node, event, guard, action, head))
+        self.guarded.sort(key=lambda g: (graph.nodes.index(g[0]), g[1]))
+        self.guarded = [(self.state(n), self.events[e][0],
+                         'GD_' + camel(g) if g else 'NULL', 'AC_' + camel(a) if a else 'NULL', self.state(h))
+                        for n, e, g, a, h in self.guarded]
+
+        # Events a state defers, recalled after the next state change
+        for node in graph.nodes:
+            for event in graph.node_attrs[node].get('defer', '').split(','):
+                if not words(event):
+                    continue
+                enum = '%s_EV_%s' % (prefix, upper(event))
+                if enum not in event_index:
+                    raise DotError('%s: deferred event %s has no edge' % (node, event.strip()))
+                if (node, event_index[enum]) in external:
+                    raise DotError('%s: event %s is both handled and deferred' % (node, enum))
+                external[(node, event_index[enum])] = DEFER
+
+        # An event a state doesn't handle is handled by its nearest superstate
+        # that does. The rows are flattened here so the engine finds every
+        # transition with a single table lookup whatever the nesting depth.
+        # Guarded transitions belong to the state they are drawn from, whose
+        # substates inherit its cell.
+        def resolve(node, event):
+            depth = 0
+            while node is not None:
+                if (node, event) in external:
+                    if external[(node, event)] is GUARDED and depth:
+                        return INHERIT
+                    return external[(node, event)]
+                node = graph.parents.get(node)
+                depth += 1
+                if depth > len(graph.nodes):
+                    raise DotError('clusters nest in a loop')
+            return None
+
+        transient = set(t for t, _, _ in self.internal_edges(graph))
+        for node in graph.nodes:
+            attrs = graph.node_attrs[node]
+            self.states.append((self.state(node), camel(node), attrs.get('data') or 'NoEventData',
+                                attrs.get('label', node)))
+            has_events = any((node, e) in external for e in range(len(self.events)))
+            if node in transient and not has_events:
+                # The machine never rests here, not even for its superstate
+                self.rows.append(['CANNOT_HAPPEN'] * len(self.events))
+            else:
+                targets = [resolve(node, e) for e in range(len(self.events))]
+                self.rows.append([CELLS[t] if t in CELLS else self.state(t) if t else 'EVENT_IGNORED'
+                                  for t in targets])
+
+            if node in graph.parents:
+                self.parents.append((self.state(node), self.state(graph.parents[node])))
+            history = attrs.get('history')
+            if history:
+                if history not in ('shallow', 'deep'):
+                    raise DotError('%s: history must be shallow or deep' % node)
+                if node not in graph.parents.values():
+                    raise DotError('%s: only superstates have history' % node)
+                self.history.append((self.state(node), 'SM_HISTORY_' + history.upper(), str(len(self.history))))
+            actions = attrs.get('actions', '').split()
+            if actions:
+                self.actions.append((self.state(node),
+                                     'EN_' + camel(node) if 'entry' in actions else 'NULL',
+                                     'EX_' + camel(node) if 'exit' in actions else 'NULL'))
+
+    @staticmethod
+    def internal_edges(graph):
+        for tail, head, attrs in graph.edges:
+            if 'dashed' in attrs.get('style', '') and not attrs.get('event'):
+                yield tail, head, attrs
+
+    @staticmethod
+    def state(node):
+        return 'ST_' + upper(node)
+
+
+def columns(rows, pad=2):
+    widths = [max(len(r[i]) for r in rows) for i in range(len(rows[0]))]
+    return [''.join(c.ljust(w + pad) for c, w in zip(r, widths)).rstrip() for r in rows]
+
+
+def list_macro(out, name, rows):
+    """Append an X macro list, rows end with a continuation column."""
+    out.append('#define %s%s' % (name, ' \\' if rows else ''))
+    if rows:
+        lines = columns(rows)
+        lines[-1] = lines[-1].rstrip('\\').rstrip()
+        out.extend('    ' + l for l in lines)
+    out.append('')
+
+
+# States a byte transition table has room for, the rest are sentinels
+BYTE_STATES = 251
+
+SENTINELS = ('CANNOT_HAPPEN', 'EVENT_IGNORED', 'SM_DEFER', 'SM_GUARDED')
+
+
+def displace(machine):
+    """Row displace the transition table.
+
+    Returns the (state, offset, default) of each row and the (owner state,
+    event, cell) of each cell.  Each row keeps the cells that differ from
+    its most common cell, placed first fit at an offset no other row has so
+    a cell of one row is never mistaken for a cell of another.
+    """
+    events = [e for e, _, _ in machine.events]
+    rows = []
+    for (state, _, _, _), row in zip(machine.states, machine.rows):
+        # Most common cell, EVENT_IGNORED on a tie
+        default = max(row, key=lambda c: (row.count(c), c == 'EVENT_IGNORED'))
+        rows.append((state, default, [e for e, c in enumerate(row) if c != default]))
+
+    owners = {}                 # cell index to (state, event, cell)
+    bases = {}
+    used = set()
+    order = sorted(range(len(rows)), key=lambda r: (-len(rows[r][2]), r))
+    for r in order:
+        state, default, exceptions = rows[r]
+        base = 0
+        while base in used or any(base + e in owners for e in exceptions):
+            base += 1
+        used.add(base)
+        bases[r] = base
+        for e in exceptions:
+            owners[base + e] = (state, events[e], machine.rows[r][e])
+
+    size = max(bases.values()) + len(events)
+    table_rows = [(state, str(bases[r]), default) for r, (state, default, _) in enumerate(rows)]
+    cells = [owners.get(i, ('SM_SPARSE_FREE', 'SM_SPARSE_FREE', 'SM_SPARSE_FREE')) for i in range(size)]
+    return table_rows, cells
+
+
+def generate(machine, source, guard, wide=False, sparse=False):
+    p = machine.prefix
+    out = []
+    out.append('#ifndef %s' % guard)
+    out.append('#define %s' % guard)
+    out.append('')
+    out.append('// %s FSM definition, generated from %s by tools/sm_gen.py.' % (machine.prefix, source))
+    out.append('// Do not edit, change the diagram and regenerate.  See %s in' %
+               ('SM_MACHINE_TABLE16' if wide else 'SM_MACHINE_SPARSE' if sparse else 'SM_MACHINE_TABLE'))
+    out.append('// StateMachine.h.')
+    out.append('')
+
+    out.append('// State machine events: event, event data type.  Event order is the column')
+    out.append('// order of the transition table.')
+    out.append('#define %s_EVENTS(X) \\' % p)
+    rows = [('X(%s,' % e, '%s)' % d, '/* %s */ \\' % c) for e, d, c in machine.events]
+    lines = columns(rows)
+    lines[-1] = lines[-1][:-2].rstrip()
+    out.extend('    ' + l for l in lines)
+    out.append('')
+
+    out.append('// State machine states: state, state function, state event data type and')
+    out.append('// the transition table row.')
+    out.append('#define %s_STATES(X) \\' % p)
+    table = [[c + '_16' if wide and c in SENTINELS else c for c in r] for r in machine.rows]
+    cells = [[c + ',' for c in r[:-1]] + [r[-1] + '))'] for r in table]
+    heads = [('X(%s,' % s, '%s,' % f, '%s,' % d) for s, f, d, _ in machine.states]
+    rows = [h + ('(' + c[0],) + tuple(c[1:]) + ('\\',) for h, c in zip(heads, cells)]
+    title = ('/*', '', '') + tuple(e for e, _, _ in machine.events) + ('*/ \\',)
+    lines = columns([title] + rows)
+    lines[-1] = lines[-1][:-2].rstrip()
+    out.extend('    ' + l for l in lines)
+    out.append('')
+
+    out.append('// Automatic transitions made by state functions with SM_InternalEvent:')
+    out.append('// from state, to state.')
+    list_macro(out, '%s_INTERNAL(X)' % p,
+               [('X(%s,' % f, '%s)' % t, ('/* %s */ \\' % c) if c else '\\') for f, t, c in machine.internal])
+
+    out.append('// Superstates: state, superstate.')
+    list_macro(out, '%s_PARENTS(X)' % p, [('X(%s,' % c, '%s)' % q, '\\') for c, q in machine.parents])
+
+    out.append('// Entry and exit actions: state, entry function, exit function.')
+    list_macro(out, '%s_ACTIONS(X)' % p, [('X(%s,' % c, '%s,' % n, '%s)' % x, '\\') for c, n, x in machine.actions])
+
+    out.append('// Superstates with history: superstate, history, history slot.')
+    list_macro(out, '%s_HISTORY(X)' % p, [('X(%s,' % c, '%s,' % k, '%s)' % n, '\\') for c, k, n in machine.history])
+
+    out.append('// Guarded transitions: state, event, guard, action, new state.')
+    list_macro(out, '%s_GUARDED(X)' % p, [('X(%s,' % c, '%s,' % e, '%s,' % g, '%s,' % a, '%s)' % n, '\\')
+                                          for c, e, g, a, n in machine.guarded])
+
+    if sparse:
+        rows, cells = displace(machine)
+        dense = len(machine.rows) * len(machine.events)
+        out.append('// Row displaced transition table: state, row offset, row default.  The')
+        out.append('// table has %d cells instead of %d.' % (len(cells), dense))
+        list_macro(out, '%s_SPARSE_ROWS(X)' % p, [('X(%s,' % c, '%s,' % b, '%s)' % d, '\\') for c, b, d in rows])
+
+        out.append('// Cells of the row displaced transition table: owner state, event, cell.')
+        list_macro(out, '%s_SPARSE_CELLS(X)' % p, [('X(%s,' % c, '%s,' % e, '%s)' % n, '\\') for c, e, n in cells])
+
+    out.append('#endif // %s' % guard)
+    return '\n'.join(out) + '\n'
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Generate a state machine definition from a .dot diagram')
+    parser.add_argument('dot', help='state diagram')
+    parser.add_argument('-n', '--name', help='state machine name, default from the graph name')
+    parser.add_argument('-p', '--prefix', help='event and list macro prefix, default from the name')
+    parser.add_argument('--wide', action='store_true',
+                        help='16 bit transition table, the default for more than %d states' % BYTE_STATES)
+    parser.add_argument('--sparse', action='store_true',
+                        help='also emit the row displaced transition table of SM_MACHINE_SPARSE')
+    parser.add_argument('-o', '--output', help='output header, default stdout')
+    parser.add_argument('--check', action='store_true',
+                        help="don't write the output header, fail if it is out of date")
+    args = parser.parse_args(argv)
+
+    try:
+        with open(args.dot) as f:
+            graph = parse(f.read())
+        base = re.sub(r'_fsm$', '', graph.name)
+        name = args.name or camel(base)
+        prefix = args.prefix or upper(base)
+        machine = Machine(graph, name, prefix)
+    except (DotError, IOError) as e:
+        sys.stderr.write('%s: %s\n' % (args.dot, e))
+        return 1
+
+    if not machine.events:
+        sys.stderr.write('%s: no events\n' % args.dot)
+        return 1
+
+    wide = args.wide or len(machine.states) > BYTE_STATES
+    if wide and machine.parents:
+        sys.stderr.write('%s: a machine with a 16 bit table can\'t have superstates\n' % args.dot)
+        return 1
+    if args.sparse and (wide or machine.parents):
+        sys.stderr.write('%s: a row displaced table needs at most %d states and no superstates\n' %
+                         (args.dot, BYTE_STATES))
+        return 1
+    if (wide or args.sparse) and machine.guarded:
+        sys.stderr.write('%s: a machine with guarded transitions needs a dense byte table\n' % args.dot)
+        return 1
+
+    source = args.dot.replace(os.sep, '/')
+    source = source[source.index('docs/'):] if 'docs/' in source else os.path.basename(source)
+    guard = '__X_%s' % upper(os.path.basename(args.output)) if args.output else '__X_%s_DEF_H' % prefix
+    text = generate(machine, source, guard, wide, args.sparse)
+
+    if args.output:
+        # Leave the file alone when nothing changed so it doesn't rebuild
+        try:
+            with open(args.output) as f:
+                if f.read() == text:
+                    return 0
+        except IOError:
+            pass
+        if args.check:
+            sys.stderr.write('%s is out of date with %s\n' % (args.output, args.dot))
+            return 1
+        with open(args.output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Decode a dump of the state machine trace ring, see fsm/sm_trace.h.
+
+The dump is the raw memory of SM_TraceLog, for example saved with J-Link:
+
+    J-Link> savebin trace.bin <address of SM_TraceLog> <sizeof(SM_TraceLog)>
+
+Records are printed oldest first.  State and event IDs are printed as
+numbers unless a definition header generated by sm_gen.py is given for the
+state machine, by name or by a wildcard pattern:
+
+    sm_trace.py -d 'LED*=app/fsm_led_def.h' --tick-hz 1024 trace.bin
+"""
+
+import argparse
+import fnmatch
+import re
+import struct
+import sys
+
+MAGIC = 0x52544D53
+HEADER = struct.Struct('<IHHBBHI')
+RECORD = struct.Struct('<IHBBHHHH')
+
+EVENT_DEFERRED = 0xFFFC
+EVENT_IGNORED = 0xFFFE
+CANNOT_HAPPEN = 0xFFFF
+EVENT_FUNC = 0xFF
+EVENT_INTERNAL = 0xFE
+SIZE_UNKNOWN = 0xFFFF
+
+
+class TraceError(Exception):
+    pass
+
+
+def load_definition(path):
+    """Return the state and event names listed in a definition header."""
+    with open(path) as f:
+        text = f.read()
+    lists = {}
+    for m in re.finditer(r'#define\s+\w+_(STATES|EVENTS)\(X\)((?:.*\\\n)*.*)', text):
+        lists[m.group(1)] = re.findall(r'\bX\(\s*(\w+)', m.group(2))
+    if 'STATES' not in lists or 'EVENTS' not in lists:
+        raise TraceError('%s: no state or event list' % path)
+    return lists['STATES'], lists['EVENTS']
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise TraceError('dump too short')
+    magic, record_size, record_count, name_size, machine_count, _, next_record = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise TraceError('bad magic 0x%08X, not a trace dump' % magic)
+    if record_size != RECORD.size:
+        raise TraceError('unsupported record size %d' % record_size)
+    names_offset = HEADER.size + record_size * record_count
+    if len(data) < names_offset + name_size * machine_count:
+        raise TraceError('dump too short for %d records' % record_count)
+
+    names = {}
+    for i in range(machine_count):
+        raw = data[names_offset + i * name_size:names_offset + (i + 1) * name_size]
+        names[i + 1] = raw.split(b'\0')[0].decode('ascii', 'replace')
+
+    records = []
+    dropped = 0
+    for number in range(max(0, next_record - record_count), next_record):
+        offset = HEADER.size + (number % record_count) * record_size
+        timestamp, sequence, machine, event, src, dst, size, _ = RECORD.unpack_from(data, offset)
+        # A record being written, or overwritten by a lapping writer
+        if sequence != number & 0xFFFF:
+            dropped += 1
+            continue
+        records.append((number, timestamp, names.get(machine, '#%d' % machine), event, src, dst, size))
+    return records, dropped
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Decode a state machine trace dump')
+    parser.add_argument('dump', help='binary dump of SM_TraceLog')
+    parser.add_argument('-d', '--definition', action='append', default=[], metavar='MACHINE=HEADER',
+                        help='name states and events of matching state machines from a definition header')
+    parser.add_argument('--tick-hz', type=float, help='print time stamps in seconds')
+    args = parser.parse_args(argv)
+
+    try:
+        definitions = []
+        for spec in args.definition:
+            pattern, sep, path = spec.partition('=')
+            if not sep:
+                raise TraceError('bad definition %r, expected MACHINE=HEADER' % spec)
+            definitions.append((pattern, load_definition(path)))
+        with open(args.dump, 'rb') as f:
+            records, dropped = decode(f.read())
+    except (TraceError, IOError) as e:
+        sys.stderr.write('sm_trace: %s\n' % e)
+        return 1
+
+    def lookup(machine):
+        for pattern, names in definitions:
+            if fnmatch.fnmatchcase(machine, pattern):
+                return names
+        return [], []
+
+    def name(names, value, special):
+        if value in special:
+            return special[value]
+        return names[value] if value < len(names) else str(value)
+
+    for number, timestamp, machine, event, src, dst, size in records:
+        states, events = lookup(machine)
+        time = '%12.6f' % (timestamp / args.tick_hz) if args.tick_hz else '%10u' % timestamp
+        size = '' if size == 0 else ' (? bytes)' if size == SIZE_UNKNOWN else ' (%d bytes)' % size
+        print('%8d %s  %-8s %-16s %s -> %s%s' % (
+            number, time, machine,
+            name(events, event, {EVENT_FUNC: 'event function', EVENT_INTERNAL: 'internal'}),
+            name(states, src, {}),
+            name(states, dst, {EVENT_DEFERRED: 'deferred', EVENT_IGNORED: 'ignored',
+                                  CANNOT_HAPPEN: 'CANNOT_HAPPEN'}),
+            size))
+    if dropped:
+        sys.stderr.write('sm_trace: %d records were being written and are dropped\n' % dropped)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))